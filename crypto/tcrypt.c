@@ -33,6 +33,7 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
 #include "tcrypt.h"
 #include "internal.h"
 
@@ -64,7 +65,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -719,6 +720,132 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+static u32 comp_block_sizes[] = { 1024, PAGE_SIZE, 0 };
+
+/*
+ * Something between text and binary: runs copied from a few bytes back
+ * mixed with pseudo random bytes, compressing to roughly half, which is
+ * about what swapped out anonymous memory does.
+ */
+static void test_comp_fill(u8 *buf, unsigned int len)
+{
+	u32 seed = 0x2545f491;
+	unsigned int i = 0, run;
+
+	while (i < len) {
+		seed = seed * 1103515245 + 12345;
+		run = min(len - i, 4 + ((seed >> 16) & 15));
+		if (i >= 64 && (seed & 0x100)) {
+			unsigned int back = 1 + ((seed >> 20) & 63);
+
+			for (; run; run--, i++)
+				buf[i] = buf[i - back];
+		} else {
+			for (; run; run--, i++) {
+				seed = seed * 1103515245 + 12345;
+				buf[i] = seed >> 24;
+			}
+		}
+	}
+}
+
+static int test_comp_ops(struct crypto_comp *tfm, int compress,
+			 const u8 *src, unsigned int slen, u8 *dst,
+			 unsigned int dsize, unsigned int sec, u64 *ns)
+{
+	unsigned int dlen;
+	s64 start, end;
+	int ret, ops = 0;
+
+	start = ktime_to_ns(ktime_get());
+	end = start + (s64)sec * NSEC_PER_SEC;
+	do {
+		dlen = dsize;
+		if (compress)
+			ret = crypto_comp_compress(tfm, src, slen, dst, &dlen);
+		else
+			ret = crypto_comp_decompress(tfm, src, slen, dst,
+						     &dlen);
+		if (ret)
+			return ret;
+		ops++;
+		if (!(ops & 15))
+			cond_resched();
+	} while (ktime_to_ns(ktime_get()) < end);
+
+	*ns = ktime_to_ns(ktime_get()) - start;
+	return ops;
+}
+
+/* MB/s (2^20 bytes) for @ops operations on @len bytes in @ns */
+static unsigned int test_comp_mbps(int ops, unsigned int len, u64 ns)
+{
+	u64 bytes = (u64)ops * len * USEC_PER_SEC;
+
+	do_div(ns, NSEC_PER_USEC);
+	if (!ns)
+		return 0;
+	do_div(bytes, (u32)ns);
+	return (unsigned int)(bytes >> 20);
+}
+
+static void test_comp_speed(const char *algo, unsigned int sec)
+{
+	struct crypto_comp *tfm;
+	unsigned int clen, dlen, i;
+	u8 *src = tvmem[0], *cbuf = tvmem[1], *dbuf = tvmem[2];
+	int cops, dops;
+	u64 cns, dns;
+
+	printk("\ntesting speed of %s compression\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk("failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	if (!sec)
+		sec = 1;
+
+	for (i = 0; comp_block_sizes[i]; i++) {
+		unsigned int len = comp_block_sizes[i];
+
+		test_comp_fill(src, len);
+
+		clen = PAGE_SIZE;
+		if (crypto_comp_compress(tfm, src, len, cbuf, &clen)) {
+			printk("%s: compression failed\n", algo);
+			break;
+		}
+
+		cops = test_comp_ops(tfm, 1, src, len, cbuf, PAGE_SIZE, sec,
+				     &cns);
+		dops = test_comp_ops(tfm, 0, cbuf, clen, dbuf, PAGE_SIZE, sec,
+				     &dns);
+		if (cops < 0 || dops < 0) {
+			printk("%s: operation failed\n", algo);
+			break;
+		}
+
+		dlen = PAGE_SIZE;
+		if (crypto_comp_decompress(tfm, cbuf, clen, dbuf, &dlen) ||
+		    dlen != len || memcmp(src, dbuf, len)) {
+			printk("%s: round trip mismatch\n", algo);
+			break;
+		}
+
+		printk("test %u (%u byte blocks): ratio %u%%, "
+		       "compress %u MB/s, decompress %u MB/s\n",
+		       i, len, clen * 100 / len,
+		       test_comp_mbps(cops, len, cns),
+		       test_comp_mbps(dops, len, dns));
+	}
+
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -948,6 +1075,10 @@ static int do_test(int m)
 		ret += tcrypt_test("ofb(aes)");
 		break;
 
+	case 47:
+		ret += tcrypt_test("lz4");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1239,6 +1370,24 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_comp_speed("lzo", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_comp_speed("lz4", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_comp_speed("deflate", sec);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
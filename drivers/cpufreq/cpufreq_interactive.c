@@ -198,6 +198,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 	u64 now_idle;
 	u64 now_iowait;
 	unsigned int new_freq;
+	unsigned int boost_floor;
+	unsigned int relation = CPUFREQ_RELATION_H;
 	unsigned int index;
 	unsigned long flags;
 
@@ -271,8 +273,18 @@ static void cpufreq_interactive_timer(unsigned long data)
 	new_freq = cpufreq_interactive_get_target(cpu_load, load_since_change,
 						  pcpu->policy);
 
+	/*
+	 * Never go below the frequency floor of the task group currently
+	 * running on this CPU (cpu.freq_boost_min).
+	 */
+	boost_floor = cpufreq_boost_floor(data);
+	if (new_freq < boost_floor) {
+		new_freq = boost_floor;
+		relation = CPUFREQ_RELATION_L;
+	}
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
-					   new_freq, CPUFREQ_RELATION_H,
+					   new_freq, relation,
 					   &index)) {
 		pr_warn_once("timer %d: cpufreq_frequency_table_target error\n",
 			     (int) data);
@@ -296,9 +308,11 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	/*
 	 * Can only overclock if the delay is satisfy. Otherwise, cap it to
-	 * maximum allowed normal frequency
+	 * maximum allowed normal frequency. A target raised to the task
+	 * group floor is not capped.
 	 */
-	if (max_normal_freq && (new_freq > max_normal_freq)) {
+	if (max_normal_freq && (new_freq > max_normal_freq) &&
+	    relation == CPUFREQ_RELATION_H) {
 		if (cputime64_sub(pcpu->timer_run_time, pcpu->last_high_freq_time)
 				< high_freq_min_delay) {
 			new_freq = max_normal_freq;
@@ -359,6 +373,36 @@ exit:
 	return;
 }
 
+/*
+ * Called from irq_work on @cpu when a task group with a frequency floor
+ * got switched in. Only ever raises the target, ramping down again is
+ * left to the timer once the floor is gone.
+ */
+static void cpufreq_interactive_boost(int cpu, unsigned int floor)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	unsigned int index;
+	unsigned long flags;
+
+	smp_rmb();
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   floor, CPUFREQ_RELATION_L, &index))
+		return;
+
+	if (pcpu->freq_table[index].frequency <= pcpu->target_freq)
+		return;
+
+	pcpu->target_freq = pcpu->freq_table[index].frequency;
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	cpumask_set_cpu(cpu, &up_cpumask);
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+	wake_up_process(up_task);
+}
+
 static void cpufreq_interactive_idle_start(void)
 {
 	struct cpufreq_interactive_cpuinfo *pcpu =
@@ -669,6 +713,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 				mutex_unlock(&gov_state_lock);
 				return rc;
 			}
+			cpufreq_boost_set_hook(cpufreq_interactive_boost);
 		}
 		mutex_unlock(&gov_state_lock);
 
@@ -696,6 +741,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		active_count--;
 
 		if (active_count == 0) {
+			cpufreq_boost_clear_hook(cpufreq_interactive_boost);
 			sysfs_remove_group(cpufreq_global_kobject,
 					&interactive_attr_group);
 			kobject_uevent(interactive_kobj, KOBJ_REMOVE);
@@ -30,10 +30,15 @@
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/earlysuspend.h>
+#include <linux/irq_work.h>
+#include <linux/ktime.h>
 #include <linux/td_framework.h>
 
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_tripndroid.h>
+
 extern unsigned int tdf_suspend_state;
 extern unsigned int tdf_cpu_load;
 extern unsigned int powersaving_active;
@@ -53,6 +58,13 @@ struct cpufreq_tripndroid_cpuinfo {
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
 	int governor_enabled;
+	/* scheduler driven input */
+	unsigned int cpu;
+	struct irq_work sched_work;
+	unsigned long sched_last_eval;
+	/* last decision, for the setspeed latency tracepoint */
+	ktime_t decision_time;
+	int decision_mode;
 }; 
 
 static DEFINE_PER_CPU(struct cpufreq_tripndroid_cpuinfo, cpuinfo);
@@ -84,6 +96,12 @@ static unsigned long timer_rate;
 
 static unsigned long boost_factor = 2;
 
+/*
+ * 0: ramp up from the timer only, 1: also evaluate ramp up from the
+ * scheduler wakeup/tick hooks. Ramp down always stays on the timer.
+ */
+static unsigned long sched_input;
+
 static int cpufreq_governor_tripndroid(struct cpufreq_policy *policy, unsigned int event);
 
 #ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_TRIPNDROID
@@ -96,6 +114,28 @@ struct cpufreq_governor cpufreq_gov_tripndroid = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int cpufreq_tripndroid_burst_freq(
+		struct cpufreq_tripndroid_cpuinfo *pcpu)
+{
+	if (pcpu->policy->cur == pcpu->policy->min)
+		return hispeed_freq;
+
+	if (!boost_factor)
+		return pcpu->policy->max;
+
+	return pcpu->policy->cur * boost_factor;
+}
+
+static void cpufreq_tripndroid_decision(struct cpufreq_tripndroid_cpuinfo *pcpu,
+		unsigned int load, unsigned int new_freq, int mode)
+{
+	trace_cpufreq_tripndroid_target(pcpu->cpu, load, pcpu->target_freq,
+					new_freq, mode);
+	pcpu->decision_time = ktime_get();
+	pcpu->decision_mode = mode;
+	pcpu->target_freq = new_freq;
+}
+
 static void cpufreq_tripndroid_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -107,6 +147,8 @@ static void cpufreq_tripndroid_timer(unsigned long data)
 	struct cpufreq_tripndroid_cpuinfo *pcpu = &per_cpu(cpuinfo, data);
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int boost_floor;
+	unsigned int relation = CPUFREQ_RELATION_H;
 	unsigned int index;
 	unsigned long flags;
 
@@ -166,24 +208,20 @@ static void cpufreq_tripndroid_timer(unsigned long data)
 	}
 
 	if (cpu_load >= go_hispeed_load) {
-
-		if (pcpu->policy->cur == pcpu->policy->min) {
-			new_freq = hispeed_freq;
-		}
-		else {
-
-			if (!boost_factor)
-				new_freq = pcpu->policy->max;
-
-			new_freq = pcpu->policy->cur * boost_factor;
-
-		}
+		new_freq = cpufreq_tripndroid_burst_freq(pcpu);
 	}
 	else {
 		new_freq = pcpu->policy->max * cpu_load / 100;
 	}
 
-	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table, new_freq, CPUFREQ_RELATION_H, &index)) {
+	/* never below the floor of the task group running here */
+	boost_floor = cpufreq_boost_floor(data);
+	if (new_freq < boost_floor) {
+		new_freq = boost_floor;
+		relation = CPUFREQ_RELATION_L;
+	}
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table, new_freq, relation, &index)) {
 		pr_warn_once("timer %d: cpufreq_frequency_table_target error\n", (int) data);
 			goto rearm;
 	}
@@ -201,14 +239,16 @@ static void cpufreq_tripndroid_timer(unsigned long data)
 	}
 
 	if (new_freq < pcpu->target_freq) {
-		pcpu->target_freq = new_freq;
+		cpufreq_tripndroid_decision(pcpu, cpu_load, new_freq,
+					    TRIPNDROID_MODE_TIMER);
 		spin_lock_irqsave(&down_cpumask_lock, flags);
 		cpumask_set_cpu(data, &down_cpumask);
 		spin_unlock_irqrestore(&down_cpumask_lock, flags);
 		queue_work(down_wq, &freq_scale_down_work);
 	}
 	else {
-		pcpu->target_freq = new_freq;
+		cpufreq_tripndroid_decision(pcpu, cpu_load, new_freq,
+					    TRIPNDROID_MODE_TIMER);
 		spin_lock_irqsave(&up_cpumask_lock, flags);
 		cpumask_set_cpu(data, &up_cpumask);
 		spin_unlock_irqrestore(&up_cpumask_lock, flags);
@@ -240,6 +280,119 @@ exit:
 	return;
 }
 
+/*
+ * Scheduler driven ramp up. Runs from irq_work, at the latest on the
+ * next tick after the hook fired, and looks at the load of the sample
+ * window the timer has open so far. Only ever raises the target.
+ */
+static void cpufreq_tripndroid_sched_eval(struct irq_work *work)
+{
+	struct cpufreq_tripndroid_cpuinfo *pcpu =
+		container_of(work, struct cpufreq_tripndroid_cpuinfo,
+			     sched_work);
+	unsigned int delta_idle;
+	unsigned int delta_time;
+	unsigned int new_freq;
+	unsigned int index;
+	unsigned long flags;
+	u64 idle_exit_time;
+	u64 now_idle, now;
+	int cpu_load;
+
+	smp_rmb();
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	idle_exit_time = pcpu->idle_exit_time;
+	if (!idle_exit_time)
+		return;
+
+	now_idle = get_cpu_idle_time_us(pcpu->cpu, &now);
+	delta_idle = (unsigned int) cputime64_sub(now_idle, pcpu->time_in_idle);
+	delta_time = (unsigned int) cputime64_sub(now, idle_exit_time);
+
+	/* same minimum window as the timer */
+	if (delta_time < 1000)
+		return;
+
+	if (delta_idle > delta_time)
+		cpu_load = 0;
+	else
+		cpu_load = 100 * (delta_time - delta_idle) / delta_time;
+
+	if (cpu_load < go_hispeed_load)
+		return;
+
+	new_freq = cpufreq_tripndroid_burst_freq(pcpu);
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   new_freq, CPUFREQ_RELATION_H, &index))
+		return;
+
+	new_freq = pcpu->freq_table[index].frequency;
+	if (new_freq <= pcpu->target_freq)
+		return;
+
+	cpufreq_tripndroid_decision(pcpu, cpu_load, new_freq,
+				    TRIPNDROID_MODE_SCHED);
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	cpumask_set_cpu(pcpu->cpu, &up_cpumask);
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+	wake_up_process(up_task);
+}
+
+/* called with the rq lock of @cpu held, see cpufreq_sched_set_hook() */
+static void cpufreq_tripndroid_sched_hook(int cpu, unsigned long nr_running)
+{
+	struct cpufreq_tripndroid_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+
+	if (!pcpu->governor_enabled ||
+	    pcpu->target_freq >= pcpu->policy->max)
+		return;
+
+	/* at most one evaluation per cpu and tick */
+	if (pcpu->sched_last_eval == jiffies)
+		return;
+
+	pcpu->sched_last_eval = jiffies;
+	irq_work_queue(&pcpu->sched_work);
+}
+
+/*
+ * A task group with a frequency floor got switched in, see
+ * cpufreq_boost_set_hook(). Runs from irq_work on @cpu.
+ */
+static void cpufreq_tripndroid_boost(int cpu, unsigned int floor)
+{
+	struct cpufreq_tripndroid_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	unsigned int new_freq;
+	unsigned int index;
+	unsigned long flags;
+
+	smp_rmb();
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   floor, CPUFREQ_RELATION_L, &index))
+		return;
+
+	new_freq = pcpu->freq_table[index].frequency;
+	if (new_freq <= pcpu->target_freq)
+		return;
+
+	cpufreq_tripndroid_decision(pcpu, tdf_cpu_load, new_freq,
+				    TRIPNDROID_MODE_BOOST);
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+	cpumask_set_cpu(cpu, &up_cpumask);
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+	wake_up_process(up_task);
+}
+
 static void cpufreq_tripndroid_idle_start(void)
 {
 	struct cpufreq_tripndroid_cpuinfo *pcpu =
@@ -344,6 +497,11 @@ static int cpufreq_tripndroid_up_task(void *data)
 							CPUFREQ_RELATION_H);
 			mutex_unlock(&set_speed_lock);
 
+			trace_cpufreq_tripndroid_setspeed(cpu, max_freq,
+				pcpu->decision_mode,
+				(unsigned long)ktime_us_delta(ktime_get(),
+							pcpu->decision_time));
+
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(cpu,
 						     &pcpu->freq_change_time);
@@ -390,6 +548,11 @@ static void cpufreq_tripndroid_freq_down(struct work_struct *work)
 						CPUFREQ_RELATION_H);
 
 		mutex_unlock(&set_speed_lock);
+
+		trace_cpufreq_tripndroid_setspeed(cpu, max_freq,
+			pcpu->decision_mode,
+			(unsigned long)ktime_us_delta(ktime_get(),
+						pcpu->decision_time));
 		pcpu->freq_change_time_in_idle =
 			get_cpu_idle_time_us(cpu,
 					     &pcpu->freq_change_time);
@@ -486,11 +649,41 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_sched_input(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", sched_input);
+}
+
+static ssize_t store_sched_input(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	val = !!val;
+	if (val == sched_input)
+		return count;
+
+	sched_input = val;
+	cpufreq_sched_set_hook(sched_input ?
+			       cpufreq_tripndroid_sched_hook : NULL);
+	return count;
+}
+
+static struct global_attr sched_input_attr = __ATTR(sched_input, 0644,
+		show_sched_input, store_sched_input);
+
 static struct attribute *tripndroid_attributes[] = {
 	&hispeed_freq_attr.attr,
 	&go_hispeed_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&sched_input_attr.attr,
 	NULL,
 };
 
@@ -541,6 +734,10 @@ static int cpufreq_governor_tripndroid(struct cpufreq_policy *policy,
 		if (rc)
 			return rc;
 
+		if (sched_input)
+			cpufreq_sched_set_hook(cpufreq_tripndroid_sched_hook);
+		cpufreq_boost_set_hook(cpufreq_tripndroid_boost);
+
 		break;
 
 	case CPUFREQ_GOV_STOP:
@@ -563,6 +760,11 @@ static int cpufreq_governor_tripndroid(struct cpufreq_policy *policy,
 		if (atomic_dec_return(&active_count) > 0)
 			return 0;
 
+		cpufreq_sched_set_hook(NULL);
+		cpufreq_boost_clear_hook(cpufreq_tripndroid_boost);
+		for_each_possible_cpu(j)
+			irq_work_sync(&per_cpu(cpuinfo, j).sched_work);
+
 		sysfs_remove_group(cpufreq_global_kobject,
 				&tripndroid_attr_group);
 
@@ -614,6 +816,8 @@ static int __init cpufreq_tripndroid_init(void)
 		init_timer(&pcpu->cpu_timer);
 		pcpu->cpu_timer.function = cpufreq_tripndroid_timer;
 		pcpu->cpu_timer.data = i;
+		pcpu->cpu = i;
+		init_irq_work(&pcpu->sched_work, cpufreq_tripndroid_sched_eval);
 	}
 
 	up_task = kthread_create(cpufreq_tripndroid_up_task, NULL,
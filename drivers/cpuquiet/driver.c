@@ -0,0 +1,339 @@
+/*
+ * drivers/cpuquiet/driver.c
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/mutex.h>
+#include <linux/module.h>
+#include <linux/cpuquiet.h>
+#include <linux/cpu.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/notifier.h>
+#include <asm/cputime.h>
+
+#include "cpuquiet.h"
+
+struct cpuquiet_latency {
+	unsigned int count;
+	u64 total_us;
+	unsigned int last_us;
+	unsigned int max_us;
+};
+
+struct cpuquiet_cpu_stat {
+	cputime64_t time_up_total;
+	u64 last_update;
+	unsigned int up_down_count;
+	/* pending governor request, used to measure request-to-done latency */
+	ktime_t request_time;
+	int request;
+	struct cpuquiet_latency up_latency;
+	struct cpuquiet_latency down_latency;
+	struct kobject cpu_kobject;
+};
+
+enum {
+	CPQ_REQ_NONE = 0,
+	CPQ_REQ_UP,
+	CPQ_REQ_DOWN,
+};
+
+struct cpu_attribute {
+	struct attribute attr;
+	enum { up_down_count, time_up_total, up_latency, down_latency } type;
+};
+
+static struct cpuquiet_driver *cpuquiet_curr_driver;
+static struct cpuquiet_cpu_stat *stats;
+static DEFINE_SPINLOCK(stats_lock);
+
+#define CPU_ATTRIBUTE(_name) \
+	static struct cpu_attribute _name ## _attr = {			\
+		.attr = {.name = __stringify(_name), .mode = 0444 },	\
+		.type	= _name,					\
+}
+
+CPU_ATTRIBUTE(up_down_count);
+CPU_ATTRIBUTE(time_up_total);
+CPU_ATTRIBUTE(up_latency);
+CPU_ATTRIBUTE(down_latency);
+
+static struct attribute *cpu_attributes[] = {
+	&up_down_count_attr.attr,
+	&time_up_total_attr.attr,
+	&up_latency_attr.attr,
+	&down_latency_attr.attr,
+	NULL,
+};
+
+/* called with stats_lock held */
+static void stats_update(struct cpuquiet_cpu_stat *stat, bool up)
+{
+	u64 cur_jiffies = get_jiffies_64();
+	bool was_up = stat->up_down_count & 0x1;
+
+	if (was_up)
+		stat->time_up_total = cputime64_add(stat->time_up_total,
+			cputime64_sub(cur_jiffies, stat->last_update));
+
+	if (was_up != up)
+		stat->up_down_count++;
+
+	stat->last_update = cur_jiffies;
+}
+
+/* called with stats_lock held */
+static void latency_update(struct cpuquiet_cpu_stat *stat, bool up)
+{
+	struct cpuquiet_latency *lat;
+	s64 delta_us;
+
+	if (stat->request != (up ? CPQ_REQ_UP : CPQ_REQ_DOWN))
+		return;
+
+	lat = up ? &stat->up_latency : &stat->down_latency;
+	delta_us = ktime_us_delta(ktime_get(), stat->request_time);
+
+	lat->count++;
+	lat->total_us += delta_us;
+	lat->last_us = delta_us;
+	if (delta_us > lat->max_us)
+		lat->max_us = delta_us;
+
+	stat->request = CPQ_REQ_NONE;
+}
+
+static void request_start(unsigned int cpunumber, int request)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats_lock, flags);
+	/* a request still in flight keeps its original timestamp */
+	if (stats[cpunumber].request != request) {
+		stats[cpunumber].request = request;
+		stats[cpunumber].request_time = ktime_get();
+	}
+	spin_unlock_irqrestore(&stats_lock, flags);
+}
+
+static void request_cancel(unsigned int cpunumber)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stats_lock, flags);
+	stats[cpunumber].request = CPQ_REQ_NONE;
+	spin_unlock_irqrestore(&stats_lock, flags);
+}
+
+int cpuquiet_quiesence_cpu(unsigned int cpunumber)
+{
+	int err = -EPERM;
+
+	if (cpunumber >= nr_cpu_ids)
+		return -EINVAL;
+
+	if (cpuquiet_curr_driver && cpuquiet_curr_driver->quiesence_cpu) {
+		request_start(cpunumber, CPQ_REQ_DOWN);
+		err = cpuquiet_curr_driver->quiesence_cpu(cpunumber);
+		/* -EBUSY means the driver queued the request */
+		if (err && err != -EBUSY)
+			request_cancel(cpunumber);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(cpuquiet_quiesence_cpu);
+
+int cpuquiet_wake_cpu(unsigned int cpunumber)
+{
+	int err = -EPERM;
+
+	if (cpunumber >= nr_cpu_ids)
+		return -EINVAL;
+
+	if (cpuquiet_curr_driver && cpuquiet_curr_driver->wake_cpu) {
+		request_start(cpunumber, CPQ_REQ_UP);
+		err = cpuquiet_curr_driver->wake_cpu(cpunumber);
+		if (err && err != -EBUSY)
+			request_cancel(cpunumber);
+	}
+
+	return err;
+}
+EXPORT_SYMBOL(cpuquiet_wake_cpu);
+
+/*
+ * Account every transition, whoever caused it, so user space hotplug
+ * through sysfs does not throw the statistics out of sync.
+ */
+static int cpuquiet_cpu_callback(struct notifier_block *nfb,
+					unsigned long action, void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+	unsigned long flags;
+
+	if (cpu >= nr_cpu_ids)
+		return NOTIFY_OK;
+
+	switch (action) {
+	case CPU_ONLINE:
+	case CPU_DEAD:
+		spin_lock_irqsave(&stats_lock, flags);
+		stats_update(&stats[cpu], action == CPU_ONLINE);
+		latency_update(&stats[cpu], action == CPU_ONLINE);
+		spin_unlock_irqrestore(&stats_lock, flags);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __refdata cpuquiet_cpu_notifier = {
+	.notifier_call = cpuquiet_cpu_callback,
+};
+
+static ssize_t show_latency(struct cpuquiet_latency *lat, char *buf)
+{
+	u64 avg = lat->total_us;
+
+	if (lat->count)
+		do_div(avg, lat->count);
+
+	return sprintf(buf, "count: %u avg_us: %llu max_us: %u last_us: %u\n",
+			lat->count, avg, lat->max_us, lat->last_us);
+}
+
+static ssize_t stats_sysfs_show(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	struct cpu_attribute *cattr =
+		container_of(attr, struct cpu_attribute, attr);
+	struct cpuquiet_cpu_stat *stat =
+		container_of(kobj, struct cpuquiet_cpu_stat, cpu_kobject);
+	struct cpuquiet_cpu_stat snap;
+	unsigned long flags;
+	ssize_t len = 0;
+
+	spin_lock_irqsave(&stats_lock, flags);
+	stats_update(stat, stat->up_down_count & 0x1);
+	snap = *stat;
+	spin_unlock_irqrestore(&stats_lock, flags);
+
+	switch (cattr->type) {
+	case up_down_count:
+		len = sprintf(buf, "%u\n", snap.up_down_count);
+		break;
+	case time_up_total:
+		len = sprintf(buf, "%llu\n",
+			cputime64_to_clock_t(snap.time_up_total));
+		break;
+	case up_latency:
+		len = show_latency(&snap.up_latency, buf);
+		break;
+	case down_latency:
+		len = show_latency(&snap.down_latency, buf);
+		break;
+	}
+
+	return len;
+}
+
+static const struct sysfs_ops stats_sysfs_ops = {
+	.show = stats_sysfs_show,
+};
+
+static struct kobj_type ktype_cpu_stats = {
+	.sysfs_ops = &stats_sysfs_ops,
+	.default_attrs = cpu_attributes,
+};
+
+int cpuquiet_register_driver(struct cpuquiet_driver *drv)
+{
+	unsigned int cpu;
+	struct device *dev;
+	u64 cur_jiffies;
+
+	if (!drv)
+		return -EINVAL;
+
+	if (cpuquiet_curr_driver)
+		return -EBUSY;
+
+	stats = kzalloc(nr_cpu_ids * sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	cur_jiffies = get_jiffies_64();
+	for_each_possible_cpu(cpu) {
+		stats[cpu].last_update = cur_jiffies;
+		if (cpu_online(cpu))
+			stats[cpu].up_down_count = 1;
+		dev = get_cpu_device(cpu);
+		if (dev) {
+			cpuquiet_add_dev(dev, cpu);
+			cpuquiet_cpu_kobject_init(&stats[cpu].cpu_kobject,
+					&ktype_cpu_stats, "stats", cpu);
+		}
+	}
+
+	register_hotcpu_notifier(&cpuquiet_cpu_notifier);
+
+	mutex_lock(&cpuquiet_lock);
+	cpuquiet_curr_driver = drv;
+	cpuquiet_switch_governor(cpuquiet_get_first_governor());
+	mutex_unlock(&cpuquiet_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(cpuquiet_register_driver);
+
+struct cpuquiet_driver *cpuquiet_get_driver(void)
+{
+	return cpuquiet_curr_driver;
+}
+
+void cpuquiet_unregister_driver(struct cpuquiet_driver *drv)
+{
+	unsigned int cpu;
+
+	if (drv != cpuquiet_curr_driver) {
+		WARN(1, "cpuquiet: invalid cpuquiet_unregister_driver(%s)\n",
+			drv->name);
+		return;
+	}
+
+	/* stop current governor first */
+	mutex_lock(&cpuquiet_lock);
+	cpuquiet_switch_governor(NULL);
+	cpuquiet_curr_driver = NULL;
+	mutex_unlock(&cpuquiet_lock);
+
+	unregister_hotcpu_notifier(&cpuquiet_cpu_notifier);
+
+	for_each_possible_cpu(cpu) {
+		kobject_put(&stats[cpu].cpu_kobject);
+		cpuquiet_remove_dev(cpu);
+	}
+
+	kfree(stats);
+	stats = NULL;
+}
+EXPORT_SYMBOL(cpuquiet_unregister_driver);
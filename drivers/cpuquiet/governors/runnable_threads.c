@@ -0,0 +1,270 @@
+/*
+ * drivers/cpuquiet/governors/runnable_threads.c
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuquiet.h>
+#include <linux/cpumask.h>
+#include <linux/module.h>
+#include <linux/pm_qos_params.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+
+typedef enum {
+	DISABLED,
+	IDLE,
+	DOWN,
+	UP,
+} RUNNABLES_STATE;
+
+static struct delayed_work runnables_work;
+static struct kobject *runnables_kobject;
+static struct workqueue_struct *runnables_wq;
+
+/* configurable parameters */
+static unsigned int sample_rate = 20;		/* msec */
+static unsigned int nr_run_hysteresis = 25;	/* 1/4 thread */
+
+static RUNNABLES_STATE runnables_state;
+
+/*
+ * avg run threads * 100 as returned by sched_get_nr_running_avg()
+ * (e.g., 225 = 2.25 threads)
+ */
+static unsigned int nr_run_thresholds[] = {
+/*      1,    2,    3,  4 - on-line cpus target */
+	125,  225,  250, UINT_MAX
+};
+
+static unsigned int nr_run_last;
+
+static DEFINE_MUTEX(runnables_work_lock);
+
+static void update_runnables_state(void)
+{
+	unsigned int nr_cpus = num_online_cpus();
+	unsigned int max_cpus = pm_qos_request(PM_QOS_MAX_ONLINE_CPUS) ? : 4;
+	unsigned int min_cpus = pm_qos_request(PM_QOS_MIN_ONLINE_CPUS);
+	unsigned int nr_run;
+	int avg_nr_run;
+
+	if (runnables_state == DISABLED)
+		return;
+
+	sched_get_nr_running_avg(&avg_nr_run);
+
+	for (nr_run = 1; nr_run < ARRAY_SIZE(nr_run_thresholds); nr_run++) {
+		unsigned int nr_threshold = nr_run_thresholds[nr_run - 1];
+		if (nr_run_last <= nr_run)
+			nr_threshold += nr_run_hysteresis;
+		if (avg_nr_run <= nr_threshold)
+			break;
+	}
+	nr_run_last = nr_run;
+
+	if ((nr_cpus > max_cpus || nr_run < nr_cpus) && nr_cpus > min_cpus)
+		runnables_state = DOWN;
+	else if (nr_cpus < min_cpus || (nr_run > nr_cpus && nr_cpus < max_cpus))
+		runnables_state = UP;
+	else
+		runnables_state = IDLE;
+}
+
+/*
+ * Cores are woken in ascending order, so the highest numbered one is the
+ * one that came up last and the one that is let go first.
+ */
+static unsigned int get_last_online_cpu_n(void)
+{
+	unsigned int cpu = nr_cpu_ids;
+	unsigned int i;
+
+	for_each_online_cpu(i)
+		if (i > 0)
+			cpu = i;
+
+	return cpu;
+}
+
+static void runnables_work_func(struct work_struct *work)
+{
+	bool up = false;
+	unsigned int cpu = nr_cpu_ids;
+
+	mutex_lock(&runnables_work_lock);
+
+	update_runnables_state();
+
+	switch (runnables_state) {
+	case DISABLED:
+		mutex_unlock(&runnables_work_lock);
+		return;
+	case IDLE:
+		break;
+	case UP:
+		cpu = cpumask_next_zero(0, cpu_online_mask);
+		up = true;
+		break;
+	case DOWN:
+		cpu = get_last_online_cpu_n();
+		break;
+	default:
+		pr_err("%s: invalid cpuquiet runnable governor state %d\n",
+			__func__, runnables_state);
+		break;
+	}
+
+	if (cpu < nr_cpu_ids) {
+		if (up)
+			cpuquiet_wake_cpu(cpu);
+		else
+			cpuquiet_quiesence_cpu(cpu);
+	}
+
+	queue_delayed_work(runnables_wq, &runnables_work,
+				msecs_to_jiffies(sample_rate));
+
+	mutex_unlock(&runnables_work_lock);
+}
+
+CPQ_BASIC_ATTRIBUTE(sample_rate, 0644, uint);
+CPQ_BASIC_ATTRIBUTE(nr_run_hysteresis, 0644, uint);
+
+static struct attribute *runnables_attributes[] = {
+	&sample_rate_attr.attr,
+	&nr_run_hysteresis_attr.attr,
+	NULL,
+};
+
+static const struct sysfs_ops runnables_sysfs_ops = {
+	.show = cpuquiet_auto_sysfs_show,
+	.store = cpuquiet_auto_sysfs_store,
+};
+
+static struct kobj_type ktype_runnables = {
+	.sysfs_ops = &runnables_sysfs_ops,
+	.default_attrs = runnables_attributes,
+};
+
+static int runnables_sysfs(void)
+{
+	int err;
+
+	runnables_kobject = kzalloc(sizeof(*runnables_kobject),
+				GFP_KERNEL);
+
+	if (!runnables_kobject)
+		return -ENOMEM;
+
+	err = cpuquiet_kobject_init(runnables_kobject, &ktype_runnables,
+				"runnable_threads");
+
+	if (err)
+		kfree(runnables_kobject);
+
+	return err;
+}
+
+static void runnables_device_busy(void)
+{
+	mutex_lock(&runnables_work_lock);
+	if (runnables_state != DISABLED) {
+		runnables_state = DISABLED;
+		cancel_delayed_work(&runnables_work);
+	}
+	mutex_unlock(&runnables_work_lock);
+}
+
+static void runnables_device_free(void)
+{
+	mutex_lock(&runnables_work_lock);
+	if (runnables_state == DISABLED) {
+		runnables_state = IDLE;
+		queue_delayed_work(runnables_wq, &runnables_work, 0);
+	}
+	mutex_unlock(&runnables_work_lock);
+}
+
+static void runnables_stop(void)
+{
+	mutex_lock(&runnables_work_lock);
+	runnables_state = DISABLED;
+	mutex_unlock(&runnables_work_lock);
+
+	cancel_delayed_work_sync(&runnables_work);
+	destroy_workqueue(runnables_wq);
+	kobject_put(runnables_kobject);
+}
+
+static int runnables_start(void)
+{
+	int err, avg;
+
+	err = runnables_sysfs();
+	if (err)
+		return err;
+
+	runnables_wq = alloc_workqueue("cpuquiet-runnables",
+			WQ_UNBOUND | WQ_RESCUER | WQ_FREEZABLE, 1);
+	if (!runnables_wq) {
+		kobject_put(runnables_kobject);
+		return -ENOMEM;
+	}
+
+	INIT_DELAYED_WORK(&runnables_work, runnables_work_func);
+
+	/* start a fresh averaging window */
+	sched_get_nr_running_avg(&avg);
+	nr_run_last = num_online_cpus();
+
+	runnables_state = IDLE;
+	queue_delayed_work(runnables_wq, &runnables_work,
+				msecs_to_jiffies(sample_rate));
+
+	return 0;
+}
+
+static struct cpuquiet_governor runnables_governor = {
+	.name				= "runnable",
+	.start				= runnables_start,
+	.device_free_notification	= runnables_device_free,
+	.device_busy_notification	= runnables_device_busy,
+	.stop				= runnables_stop,
+	.owner				= THIS_MODULE,
+};
+
+static int __init init_runnables(void)
+{
+	return cpuquiet_register_governor(&runnables_governor);
+}
+
+static void __exit exit_runnables(void)
+{
+	cpuquiet_unregister_governor(&runnables_governor);
+}
+
+MODULE_LICENSE("GPL");
+#ifdef CONFIG_CPUQUIET_DEFAULT_GOV_RUNNABLE
+fs_initcall(init_runnables);
+#else
+module_init(init_runnables);
+#endif
+module_exit(exit_runnables);
@@ -0,0 +1,55 @@
+/*
+ * drivers/cpuquiet/governors/userspace.c
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/cpuquiet.h>
+
+/* cores are only brought up or down through cpuN/cpuquiet/active */
+static int userspace_store_active(unsigned int cpu, bool active)
+{
+	if (active)
+		return cpuquiet_wake_cpu(cpu);
+	else
+		return cpuquiet_quiesence_cpu(cpu);
+}
+
+static struct cpuquiet_governor userspace_governor = {
+	.name		= "userspace",
+	.store_active	= userspace_store_active,
+	.owner		= THIS_MODULE,
+};
+
+static int __init init_usermode(void)
+{
+	return cpuquiet_register_governor(&userspace_governor);
+}
+
+static void __exit exit_usermode(void)
+{
+	cpuquiet_unregister_governor(&userspace_governor);
+}
+
+MODULE_LICENSE("GPL");
+#ifdef CONFIG_CPUQUIET_DEFAULT_GOV_USERSPACE
+fs_initcall(init_usermode);
+#else
+module_init(init_usermode);
+#endif
+module_exit(exit_usermode);
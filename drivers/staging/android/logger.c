@@ -25,6 +25,8 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/io.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -33,17 +35,24 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Writers don't take any lock. A writer reserves room for its entry by
+ * moving 'w_resv' forward with cmpxchg, copies the entry in and then
+ * publishes it by moving 'w_off' past it, in reservation order. Readers
+ * only ever look at entries before 'w_off' and detect being lapped from
+ * 'w_resv'. All offsets are free running, logger_offset() turns them into
+ * an index into the buffer. They live in the control page, which readers
+ * can map together with the buffer, see logger_mmap(). The mutex 'mutex'
+ * only protects the list of readers.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
-	wait_queue_head_t	wq;	/* wait queue for readers */
+	wait_queue_head_t	wq;	/* wait queue for readers and writers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct mutex		mutex;	/* mutex protecting readers */
+	struct logger_mmap_control *ctl; /* offsets, see logger.h */
 	size_t			size;	/* size of the log */
 };
 
@@ -51,12 +60,13 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by reader->mutex.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* mutex protecting r_off */
+	u32			r_off;	/* current read head offset */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
 };
@@ -88,39 +98,44 @@ static inline struct logger_log *file_get_log(struct file *file)
 }
 
 /*
- * get_entry_header - returns a pointer to the logger_entry header within
- * 'log' starting at offset 'off'. A temporary logger_entry 'scratch' must
- * be provided. Typically the return value will be a pointer within
- * 'logger->buf'.  However, a pointer to 'scratch' may be returned if
- * the log entry spans the end and beginning of the circular buffer.
+ * get_entry_header - copies the logger_entry header within 'log' starting at
+ * offset 'off' to 'entry'. The header may span the end and beginning of the
+ * circular buffer. A copy is taken as a writer may overwrite the original
+ * at any time, see entry_lapped().
  */
-static struct logger_entry *get_entry_header(struct logger_log *log,
-		size_t off, struct logger_entry *scratch)
+static void get_entry_header(struct logger_log *log, u32 off,
+			     struct logger_entry *entry)
 {
-	size_t len = min(sizeof(struct logger_entry), log->size - off);
-	if (len != sizeof(struct logger_entry)) {
-		memcpy(((void *) scratch), log->buffer + off, len);
-		memcpy(((void *) scratch) + len, log->buffer,
-			sizeof(struct logger_entry) - len);
-		return scratch;
-	}
+	size_t len;
 
-	return (struct logger_entry *) (log->buffer + off);
+	off = logger_offset(off);
+	len = min(sizeof(struct logger_entry), log->size - off);
+	memcpy(((void *) entry), log->buffer + off, len);
+	if (len != sizeof(struct logger_entry))
+		memcpy(((void *) entry) + len, log->buffer,
+			sizeof(struct logger_entry) - len);
 }
 
 /*
  * get_entry_msg_len - Grabs the length of the message of the entry
  * starting from from 'off'.
- *
- * Caller needs to hold log->mutex.
  */
-static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
+static __u32 get_entry_msg_len(struct logger_log *log, u32 off)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
+	struct logger_entry entry;
 
-	entry = get_entry_header(log, off, &scratch);
-	return entry->len;
+	get_entry_header(log, off, &entry);
+	return entry.len;
+}
+
+/*
+ * entry_lapped - did a writer reserve the space of the entry at 'off'? Any
+ * data read from the entry before can't be trusted then.
+ */
+static inline bool entry_lapped(struct logger_log *log, u32 off)
+{
+	smp_rmb();
+	return ACCESS_ONCE(log->ctl->w_resv) - off > log->size;
 }
 
 static size_t get_user_hdr_len(int ver)
@@ -156,18 +171,18 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log_to_user - reads the entry at the reader's offset, whose header
+ * is 'entry', from 'log' into the user-space buffer 'buf'. Returns the number
+ * of bytes read on success, or 0 if a writer lapped the reader meanwhile.
  *
- * Caller must hold log->mutex.
+ * Caller must hold reader->mutex.
  */
 static ssize_t do_read_log_to_user(struct logger_log *log,
 				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+				   struct logger_entry *entry,
+				   char __user *buf)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
+	size_t count = entry->len;
 	size_t len;
 	size_t msg_start;
 
@@ -175,11 +190,9 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * First, copy the header to userspace, using the version of
 	 * the header requested
 	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
 	if (copy_header_to_user(reader->r_ver, entry, buf))
 		return -EFAULT;
 
-	count -= get_user_hdr_len(reader->r_ver);
 	buf += get_user_hdr_len(reader->r_ver);
 	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
 
@@ -200,34 +213,88 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+	/* did a writer overwrite what we just copied? */
+	if (entry_lapped(log, reader->r_off))
+		return 0;
+
+	reader->r_off += sizeof(struct logger_entry) + count;
 
 	return count + get_user_hdr_len(reader->r_ver);
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * fix_up_reader - pull a reader that was lapped by the writers forward to
+ * the oldest entry still in the log.
+ *
+ * Caller must hold reader->mutex.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static void fix_up_reader(struct logger_log *log, struct logger_reader *reader)
 {
-	while (off != log->w_off) {
-		struct logger_entry *entry;
-		struct logger_entry scratch;
-		size_t next_len;
+	/* the writer that lapped the head is about to pull it forward */
+	while (entry_lapped(log, reader->r_off)) {
+		reader->r_off = ACCESS_ONCE(log->ctl->head);
+		cpu_relax();
+	}
+}
 
-		entry = get_entry_header(log, off, &scratch);
+/*
+ * find_next_entry - moves the reader to the next entry it may read, and
+ * copies its header to 'entry'. Returns false if there is none.
+ *
+ * Caller must hold reader->mutex.
+ */
+static bool find_next_entry(struct logger_log *log,
+			    struct logger_reader *reader,
+			    struct logger_entry *entry)
+{
+	u32 w_off = ACCESS_ONCE(log->ctl->w_off);
+
+	/* pairs with the barrier in logger_aio_write() */
+	smp_rmb();
+	while (reader->r_off != w_off) {
+		get_entry_header(log, reader->r_off, entry);
+		if (unlikely(entry_lapped(log, reader->r_off))) {
+			fix_up_reader(log, reader);
+			w_off = ACCESS_ONCE(log->ctl->w_off);
+			smp_rmb();
+			continue;
+		}
+		if (reader->r_all || entry->euid == current_euid())
+			return true;
+		reader->r_off += sizeof(struct logger_entry) + entry->len;
+	}
 
-		if (entry->euid == euid)
-			return off;
+	return false;
+}
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(off + next_len);
-	}
+/*
+ * read_next_entry - reads the next entry the reader may read into 'buf', if
+ * it fits in 'count' bytes. Returns the number of bytes read, 0 if there is
+ * no entry, or a negative error code.
+ *
+ * Caller must hold reader->mutex.
+ */
+static ssize_t read_next_entry(struct logger_log *log,
+			       struct logger_reader *reader,
+			       char __user *buf, size_t count)
+{
+	struct logger_entry entry;
+	ssize_t ret;
 
-	return off;
+	do {
+		if (!find_next_entry(log, reader, &entry))
+			return 0;
+
+		/* get the size of the next entry */
+		ret = get_user_hdr_len(reader->r_ver) + entry.len;
+		if (count < ret)
+			return -EINVAL;
+
+		/* get exactly one entry from the log */
+		ret = do_read_log_to_user(log, reader, &entry, buf);
+	} while (!ret);
+
+	return ret;
 }
 
 /*
@@ -254,9 +321,7 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		ret = (ACCESS_ONCE(log->ctl->w_off) == reader->r_off);
 		if (!ret)
 			break;
 
@@ -277,139 +342,136 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
-
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
+	mutex_lock(&reader->mutex);
+	ret = read_next_entry(log, reader, buf, count);
+	mutex_unlock(&reader->mutex);
 
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+	if (unlikely(!ret))
 		goto start;
-	}
-
-	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
-
-out:
-	mutex_unlock(&log->mutex);
 
 	return ret;
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
- *
- * Caller must hold log->mutex.
+ * logger_read_batch - reads as many whole entries as fit into the buffer
+ * described by 'arg', laid out as successive read()s would return them.
+ * Blocks like read() until there is at least one. Returns the number of
+ * bytes read; entries copied before a fault are consumed and counted, the
+ * faulting one is left for the next read.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static long logger_read_batch(struct file *file, void __user *arg)
 {
-	size_t count = 0;
-
-	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+	struct logger_reader *reader = file->private_data;
+	struct logger_log *log = reader->log;
+	struct logger_read_batch batch;
+	char __user *buf;
+	ssize_t ret;
+	size_t count;
 
-	return off;
-}
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	buf = (char __user *)(unsigned long)batch.buf;
 
-/*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
- */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
+	ret = logger_read(file, buf, batch.size, NULL);
+	if (ret < 0)
+		return ret;
+	count = ret;
+	batch.nr = 1;
+
+	mutex_lock(&reader->mutex);
+	while (count < batch.size) {
+		ret = read_next_entry(log, reader, buf + count,
+				      batch.size - count);
+		if (ret <= 0)
+			break;
+		count += ret;
+		batch.nr++;
 	}
+	mutex_unlock(&reader->mutex);
 
-	return 0;
-}
+	/* if this faults the caller can still walk the entries by length */
+	put_user(batch.nr, &((struct logger_read_batch __user *)arg)->nr);
 
-/*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
- *
- * The caller needs to hold log->mutex.
- */
-static void fix_up_readers(struct logger_log *log, size_t len)
-{
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
-
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
-
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	return count;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log - writes 'len' bytes from 'buf' to 'log' at offset 'off'
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, u32 off,
+			 const void *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
+ * the log 'log' at offset 'off'
  *
  * Returns 'count' on success, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
+static ssize_t do_write_log_from_user(struct logger_log *log, u32 off,
 				      const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	off = logger_offset(off);
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
-
 	return count;
 }
 
+/*
+ * reserve_entry - reserves 'len' bytes at the end of 'log' and returns their
+ * offset. Any entries the reservation overwrites are dropped from the head
+ * of the log first. Readers that were still on them notice on their own.
+ */
+static u32 reserve_entry(struct logger_log *log, u32 len)
+{
+	u32 off, head;
+
+	preempt_disable();
+	for (;;) {
+		off = ACCESS_ONCE(log->ctl->w_resv);
+		/* don't overwrite entries other writers are still copying */
+		if (unlikely(off + len - ACCESS_ONCE(log->ctl->w_off) > log->size)) {
+			preempt_enable();
+			wait_event(log->wq, ACCESS_ONCE(log->ctl->w_resv) + len -
+				   ACCESS_ONCE(log->ctl->w_off) <= log->size);
+			preempt_disable();
+			continue;
+		}
+		if (cmpxchg(&log->ctl->w_resv, off, off + len) == off)
+			break;
+	}
+
+	/*
+	 * Everything we overwrite is published, so its header is valid. If
+	 * another writer moved the head meanwhile, cmpxchg fails and we
+	 * retry from its head.
+	 */
+	while (off + len - (head = ACCESS_ONCE(log->ctl->head)) > log->size)
+		cmpxchg(&log->ctl->head, head, head + sizeof(struct logger_entry) +
+			get_entry_msg_len(log, head));
+	preempt_enable();
+
+	return off;
+}
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
@@ -419,9 +481,9 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	u32 orig, off;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -438,17 +500,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	orig = reserve_entry(log, sizeof(struct logger_entry) + header.len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, orig, &header, sizeof(struct logger_entry));
+	off = orig + sizeof(struct logger_entry);
 
 	while (nr_segs-- > 0) {
 		size_t len;
@@ -458,27 +513,82 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
+		nr = do_write_log_from_user(log, off, iov->iov_base, len);
 		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+			/*
+			 * The space can't be given back once later writers
+			 * reserved behind it, publish the entry blanked.
+			 */
+			len = header.len - ret;
+			while (len) {
+				size_t n = min(len, log->size -
+					       logger_offset(off));
+				memset(log->buffer + logger_offset(off), 0, n);
+				off += n;
+				len -= n;
+			}
+			ret = nr;
+			break;
 		}
 
 		iov++;
+		off += nr;
 		ret += nr;
 	}
 
-	mutex_unlock(&log->mutex);
+	/* entries are published in the order they were reserved */
+	if (ACCESS_ONCE(log->ctl->w_off) != orig)
+		wait_event(log->wq, ACCESS_ONCE(log->ctl->w_off) == orig);
+	smp_wmb();
+	log->ctl->w_off = orig + sizeof(struct logger_entry) + header.len;
 
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	/* wake up any blocked readers, and writers waiting for their turn */
+	wake_up(&log->wq);
 
 	return ret;
 }
 
 static struct logger_log *get_log_from_minor(int);
 
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the control page of the log followed by its buffer, read-only, so a
+ * reader can drain the log without a system call per entry. Only readers
+ * that may read all entries can map the log, as it can't be filtered.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_reader *reader;
+	struct logger_log *log;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	reader = file->private_data;
+	log = reader->log;
+
+	if (!reader->r_all || (vma->vm_flags & VM_WRITE))
+		return -EPERM;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start != PAGE_SIZE + log->size)
+		return -EINVAL;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(log->ctl) >> PAGE_SHIFT,
+			      PAGE_SIZE, vma->vm_page_prot);
+	if (ret)
+		return ret;
+
+	return remap_pfn_range(vma, vma->vm_start + PAGE_SIZE,
+			       virt_to_phys(log->buffer) >> PAGE_SHIFT,
+			       log->size, vma->vm_page_prot);
+}
+
 /*
  * logger_open - the log's open() file operation
  *
@@ -510,9 +620,10 @@ static int logger_open(struct inode *inode, struct file *file)
 			capable(CAP_SYSLOG);
 
 		INIT_LIST_HEAD(&reader->list);
+		mutex_init(&reader->mutex);
 
 		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
+		reader->r_off = ACCESS_ONCE(log->ctl->head);
 		list_add_tail(&reader->list, &log->readers);
 		mutex_unlock(&log->mutex);
 
@@ -555,6 +666,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 {
 	struct logger_reader *reader;
 	struct logger_log *log;
+	struct logger_entry entry;
 	unsigned int ret = POLLOUT | POLLWRNORM;
 
 	if (!(file->f_mode & FMODE_READ))
@@ -565,14 +677,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	if (log->w_off != reader->r_off)
+	mutex_lock(&reader->mutex);
+	if (find_next_entry(log, reader, &entry))
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -594,11 +702,11 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	struct logger_entry entry;
+	u32 head, w_off;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
-	mutex_lock(&log->mutex);
-
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
 		ret = log->size;
@@ -609,10 +717,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		mutex_lock(&reader->mutex);
+		fix_up_reader(log, reader);
+		ret = ACCESS_ONCE(log->ctl->w_off) - reader->r_off;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -621,15 +729,12 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 		reader = file->private_data;
 
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
-
-		if (log->w_off != reader->r_off)
-			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
+		mutex_lock(&reader->mutex);
+		if (find_next_entry(log, reader, &entry))
+			ret = get_user_hdr_len(reader->r_ver) + entry.len;
 		else
 			ret = 0;
+		mutex_unlock(&reader->mutex);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
@@ -641,9 +746,20 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EPERM;
 			break;
 		}
-		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+		mutex_lock(&log->mutex);
+		w_off = ACCESS_ONCE(log->ctl->w_off);
+		/* writers may have pulled the head past w_off meanwhile */
+		do {
+			head = ACCESS_ONCE(log->ctl->head);
+			if (w_off - head > log->size)
+				break;
+		} while (cmpxchg(&log->ctl->head, head, w_off) != head);
+		list_for_each_entry(reader, &log->readers, list) {
+			mutex_lock(&reader->mutex);
+			reader->r_off = w_off;
+			mutex_unlock(&reader->mutex);
+		}
+		mutex_unlock(&log->mutex);
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -660,12 +776,19 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
+		mutex_lock(&reader->mutex);
 		ret = logger_set_version(reader, argp);
+		mutex_unlock(&reader->mutex);
+		break;
+	case LOGGER_READ_BATCH:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		ret = logger_read_batch(file, argp);
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
-
 	return ret;
 }
 
@@ -674,19 +797,31 @@ static const struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
 	.release = logger_release,
 };
 
+/* the control page of a log, a page of its own so it can be mapped */
+union logger_control_page {
+	struct logger_mmap_control	ctl;
+	unsigned char			page[PAGE_SIZE];
+};
+
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, and greater than
+ * must be a power of two, at least a page, and greater than
  * (LOGGER_ENTRY_MAX_PAYLOAD + sizeof(struct logger_entry)).
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
+static union logger_control_page _ctl_ ## VAR __aligned(PAGE_SIZE) = { \
+	.ctl = { \
+		.size = SIZE, \
+	}, \
+}; \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -698,8 +833,7 @@ static struct logger_log VAR = { \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
-	.w_off = 0, \
-	.head = 0, \
+	.ctl = &_ctl_ ## VAR .ctl, \
 	.size = SIZE, \
 };
 
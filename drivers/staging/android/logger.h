@@ -51,6 +51,31 @@ struct logger_entry {
 	char		msg[0];		/* the entry's payload */
 };
 
+/*
+ * The control page at the start of a log mapped with mmap(), followed by the
+ * 'size' bytes of the log buffer. Offsets are free running, the entry at
+ * offset 'off' starts at (off & (size - 1)) in the buffer, and may wrap
+ * around its end. Entries before 'w_off' are complete, the oldest one is at
+ * 'head'. Writers may overwrite an entry at any time: data read from offset
+ * 'off' is only valid if 'w_resv' - 'off' <= 'size' after it was read.
+ */
+struct logger_mmap_control {
+	__u32		w_resv;		/* end of the reserved entries */
+	__u32		w_off;		/* end of the complete entries */
+	__u32		head;		/* offset of the oldest entry */
+	__u32		size;		/* size of the log buffer */
+};
+
+/*
+ * The argument of LOGGER_READ_BATCH. Entries are read into 'buf' the way
+ * successive read()s would return them.
+ */
+struct logger_read_batch {
+	__u64		buf;		/* buffer for the entries */
+	__u32		size;		/* size of the buffer */
+	__u32		nr;		/* number of entries read */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -66,5 +91,7 @@ struct logger_entry {
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
 #define LOGGER_GET_VERSION		_IO(__LOGGERIO, 5) /* abi version */
 #define LOGGER_SET_VERSION		_IO(__LOGGERIO, 6) /* abi version */
+#define LOGGER_READ_BATCH		_IOWR(__LOGGERIO, 7, \
+					      struct logger_read_batch)
 
 #endif /* _LINUX_LOGGER_H */
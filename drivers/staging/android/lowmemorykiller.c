@@ -15,6 +15,10 @@
  * The driver considers memory used for caches to be free, but if a large
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
+ * To make up for it the thresholds are scaled by the reclaim pressure level,
+ * in percent from /sys/module/lowmemorykiller/parameters/pressure_scale for
+ * the low, medium and critical levels. Memory is freed later while reclaim
+ * easily finds cache to drop, and earlier when it is thrashing.
  *
  * Copyright (C) 2007-2008 Google, Inc.
  *
@@ -35,6 +39,12 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/vmpressure.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -60,6 +70,11 @@ static size_t lowmem_fork_boost_minfree[6] = {
 	9 * 1024,
 };
 static size_t minfree_tmp[6] = {0, 0, 0, 0, 0, 0};
+static uint32_t lowmem_pressure_scale[VMPRESSURE_NUM_LEVELS] = {
+	75,	/* low */
+	100,	/* medium */
+	150,	/* critical */
+};
 
 static size_t fork_boost_adj[6] = {
 	0,
@@ -76,6 +91,19 @@ static unsigned long lowmem_fork_boost_timeout;
 static uint32_t lowmem_fork_boost = 1;
 static int last_min_adj = OOM_ADJUST_MAX + 1;;
 
+/*
+ * Thread group leaders by oom_adj, so the shrinker only has to look at the
+ * tasks with the highest oom_adj instead of walking every process. Tasks
+ * are added on fork and moved when their oom_adj is written. A thread that
+ * took over a thread group in exec() is added on its next oom_adj write.
+ */
+#define LOWMEM_INDEX_SIZE	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+static struct list_head lowmem_index[LOWMEM_INDEX_SIZE];
+static DEFINE_SPINLOCK(lowmem_index_lock);
+
+/* tasks pinned from the index at a time, to inspect them without its lock */
+#define LOWMEM_SCAN_BATCH	16
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -145,13 +173,48 @@ static int
 task_free_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
+	unsigned long flags;
 
 	if (task == lowmem_deathpending)
 		lowmem_deathpending = NULL;
 
+	/* nothing can add the task any more, so this check is stable */
+	if (!list_empty(&task->lowmem_entry)) {
+		spin_lock_irqsave(&lowmem_index_lock, flags);
+		list_del_init(&task->lowmem_entry);
+		spin_unlock_irqrestore(&lowmem_index_lock, flags);
+	}
+
 	return NOTIFY_OK;
 }
 
+/* Moves a thread group leader to the list of its current oom_adj */
+static void lowmem_index_update(struct task_struct *task)
+{
+	unsigned long flags;
+	int oom_adj;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	oom_adj = clamp(task->signal->oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+	list_move_tail(&task->lowmem_entry,
+		       &lowmem_index[oom_adj - OOM_DISABLE]);
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct task_struct *task = data;
+
+	lowmem_index_update(task->group_leader);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= oom_adj_notify_func,
+};
+
 static int
 task_fork_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -162,8 +225,13 @@ static struct notifier_block task_fork_nb = {
 static int
 task_fork_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
+	struct task_struct *task = data;
+
 	lowmem_fork_boost_timeout = jiffies + (HZ << 2);
 
+	if (thread_group_leader(task))
+		lowmem_index_update(task);
+
 	return NOTIFY_OK;
 }
 
@@ -185,6 +253,10 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int fork_boost = 0;
 	int *adj_array;
 	size_t *min_array;
+	int scanned = 0;
+	ktime_t start;
+	enum vmpressure_levels level = vmpressure_level();
+	size_t minfree;
 
 	/*
 	 * If we already have a death outstanding, then
@@ -215,17 +287,18 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	if (lowmem_minfree_size < array_size)
 		array_size = lowmem_minfree_size;
 	for (i = 0; i < array_size; i++) {
-		if (other_free < min_array[i] &&
-		    (other_file < min_array[i])) {
+		minfree = min_array[i] * lowmem_pressure_scale[level] / 100;
+		if (other_free < minfree &&
+		    (other_file < minfree)) {
 			min_adj = adj_array[i];
 			fork_boost = lowmem_fork_boost_minfree[i];
 			break;
 		}
 	}
 	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
-			     min_adj);
+		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d, "
+			     "pressure %d\n", sc->nr_to_scan, sc->gfp_mask,
+			     other_free, other_file, min_adj, level);
 	rem = global_page_state(NR_ACTIVE_ANON) +
 		global_page_state(NR_ACTIVE_FILE) +
 		global_page_state(NR_INACTIVE_ANON) +
@@ -236,43 +309,76 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		return rem;
 	}
 	selected_oom_adj = min_adj;
+	start = ktime_get();
 
+	/*
+	 * Entries stay in the index until the last put_task_struct(), and
+	 * that removal runs from RCU softirq context, so the index lock is
+	 * only held to pin a batch of tasks. They are looked at with the
+	 * lock dropped. tasklist_lock keeps a task whose mm we saw from
+	 * being released until we sent the signal.
+	 */
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+	for (i = LOWMEM_INDEX_SIZE - 1;
+	     i >= min_adj - OOM_DISABLE && !selected; i--) {
+		struct task_struct *batch[LOWMEM_SCAN_BATCH];
+		int skip = 0;
+		int nr;
+
+		do {
+			int n = 0;
+			int j;
+
+			nr = 0;
+			spin_lock_irq(&lowmem_index_lock);
+			list_for_each_entry(p, &lowmem_index[i], lowmem_entry) {
+				if (n++ < skip)
+					continue;
+				/* the final put may be running */
+				if (!atomic_inc_not_zero(&p->usage))
+					continue;
+				batch[nr++] = p;
+				if (nr == LOWMEM_SCAN_BATCH)
+					break;
+			}
+			spin_unlock_irq(&lowmem_index_lock);
+			skip = n;
+
+			for (j = 0; j < nr; j++) {
+				struct mm_struct *mm;
+				int oom_adj;
+
+				p = batch[j];
+				scanned++;
+				task_lock(p);
+				mm = p->mm;
+				oom_adj = p->signal->oom_adj;
+				if (!mm || oom_adj < min_adj) {
+					task_unlock(p);
+					put_task_struct(p);
+					continue;
+				}
+				tasksize = get_mm_rss(mm);
+				task_unlock(p);
+				if (tasksize <= 0 ||
+				    (selected && tasksize <= selected_tasksize)) {
+					put_task_struct(p);
+					continue;
+				}
+				if (selected)
+					put_task_struct(selected);
+				selected = p;
+				selected_tasksize = tasksize;
+				selected_oom_adj = oom_adj;
+				lowmem_print(2, "select %d (%s), adj %d, size %d, "
+					     "to kill\n", p->pid, p->comm, oom_adj,
+					     tasksize);
+			}
+		} while (nr == LOWMEM_SCAN_BATCH);
 	}
+	trace_lowmem_select(min_adj, scanned, selected ? selected->pid : 0,
+			    selected_oom_adj, selected_tasksize,
+			    ktime_to_ns(ktime_sub(ktime_get(), start)));
 
 	if (selected) {
 		if (last_min_adj > selected_oom_adj &&
@@ -301,6 +407,8 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
 	read_unlock(&tasklist_lock);
+	if (selected)
+		put_task_struct(selected);
 	return rem;
 }
 
@@ -311,8 +419,21 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	struct task_struct *p;
+	int i;
+
+	for (i = 0; i < LOWMEM_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(&lowmem_index[i]);
 	task_free_register(&task_free_nb);
 	task_fork_register(&task_fork_nb);
+	oom_adj_register(&oom_adj_nb);
+
+	/* index the processes that were forked before us */
+	read_lock(&tasklist_lock);
+	for_each_process(p)
+		lowmem_index_update(p);
+	read_unlock(&tasklist_lock);
+
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
@@ -320,6 +441,7 @@ static int __init lowmem_init(void)
 static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
+	oom_adj_unregister(&oom_adj_nb);
 	task_fork_unregister(&task_fork_nb);
 	task_free_unregister(&task_free_nb);
 }
@@ -331,6 +453,8 @@ module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 module_param_named(fork_boost, lowmem_fork_boost, uint, S_IRUGO | S_IWUSR);
+module_param_array_named(pressure_scale, lowmem_pressure_scale, uint, NULL,
+			 S_IRUGO | S_IWUSR);
 module_param_array_named(fork_boost_minfree, lowmem_fork_boost_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 
@@ -42,6 +42,14 @@
 #ifdef CONFIG_FRONTSWAP
 #include <linux/frontswap.h>
 #endif
+#ifdef CONFIG_ZCACHE_WRITEBACK
+#include <linux/blkdev.h>
+#include <linux/pagemap.h>
+#include <linux/swapops.h>
+#include <linux/swapfile.h>
+#include <linux/workqueue.h>
+#include <linux/writeback.h>
+#endif
 
 #if 0
 /* this is more aggressive but may cause other problems? */
@@ -637,6 +645,9 @@ struct zv_hdr {
 	uint32_t pool_id;
 	struct tmem_oid oid;
 	uint32_t index;
+#ifdef CONFIG_ZCACHE_WRITEBACK
+	struct list_head lru;
+#endif
 	DECL_SENTINEL
 };
 
@@ -658,6 +669,76 @@ static unsigned int zv_max_mean_zsize = (PAGE_SIZE / 8) * 5;
 static unsigned long zv_curr_dist_counts[NCHUNKS];
 static unsigned long zv_cumul_dist_counts[NCHUNKS];
 
+#ifdef CONFIG_ZCACHE_WRITEBACK
+/*
+ * once the number of persistent pages exceeds this percentage of RAM the
+ * least recently used ones are written back to the swap device; zero
+ * disables writeback
+ */
+static unsigned int zv_writeback_percent = 50;
+
+/* pages written back per worker pass, submitted under one block plug */
+#define ZV_WRITEBACK_BATCH	32
+
+static unsigned long zcache_writeback_pages;
+static unsigned long zcache_writeback_skipped;
+
+/*
+ * All persistent pages, most recently put or gotten at the head.  Only
+ * the writeback worker looks at the tail.
+ */
+static LIST_HEAD(zv_lru);
+static DEFINE_SPINLOCK(zv_lru_lock);
+
+static struct workqueue_struct *zv_writeback_wq;
+static void zv_writeback_work(struct work_struct *work);
+static DECLARE_WORK(zv_writeback, zv_writeback_work);
+
+static void zv_lru_add(struct zv_hdr *zv)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zv_lru_lock, flags);
+	list_add(&zv->lru, &zv_lru);
+	spin_unlock_irqrestore(&zv_lru_lock, flags);
+}
+
+static void zv_lru_del(struct zv_hdr *zv)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zv_lru_lock, flags);
+	list_del(&zv->lru);
+	spin_unlock_irqrestore(&zv_lru_lock, flags);
+}
+
+static void zv_lru_touch(struct zv_hdr *zv)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&zv_lru_lock, flags);
+	list_move(&zv->lru, &zv_lru);
+	spin_unlock_irqrestore(&zv_lru_lock, flags);
+}
+
+static unsigned long zv_writeback_limit(void)
+{
+	return (zv_writeback_percent * totalram_pages) / 100;
+}
+
+static void zv_writeback_kick(unsigned long count)
+{
+	if (zv_writeback_wq != NULL && zv_writeback_percent &&
+	    count > zv_writeback_limit())
+		queue_work(zv_writeback_wq, &zv_writeback);
+}
+#else
+static inline void zv_lru_add(struct zv_hdr *zv) { }
+static inline void zv_lru_del(struct zv_hdr *zv) { }
+static inline void zv_lru_touch(struct zv_hdr *zv) { }
+static inline void zv_writeback_kick(unsigned long count) { }
+#endif
+
 static struct zv_hdr *zv_create(struct xv_pool *xvpool, uint32_t pool_id,
 				struct tmem_oid *oid, uint32_t index,
 				void *cdata, unsigned clen)
@@ -683,6 +764,7 @@ static struct zv_hdr *zv_create(struct xv_pool *xvpool, uint32_t pool_id,
 	zv->pool_id = pool_id;
 	SET_SENTINEL(zv, ZVH);
 	memcpy((char *)zv + sizeof(struct zv_hdr), cdata, clen);
+	zv_lru_add(zv);
 	kunmap_atomic(zv, KM_USER0);
 out:
 	return zv;
@@ -698,6 +780,7 @@ static void zv_free(struct xv_pool *xvpool, struct zv_hdr *zv)
 
 	ASSERT_SENTINEL(zv, ZVH);
 	BUG_ON(chunks >= NCHUNKS);
+	zv_lru_del(zv);
 	zv_curr_dist_counts[chunks]--;
 	size -= sizeof(*zv);
 	BUG_ON(size == 0);
@@ -860,6 +943,45 @@ static ssize_t zv_page_count_policy_percent_store(struct kobject *kobj,
 	return count;
 }
 
+#ifdef CONFIG_ZCACHE_WRITEBACK
+/*
+ * setting zv_writeback_percent via sysfs sets the number of persistent
+ * pages, as a percentage of totalram_pages, above which the coldest ones
+ * are written back to the swap device.  It should stay below
+ * zv_page_count_policy_percent, or puts will be rejected before writeback
+ * ever starts.  Zero disables writeback.
+ */
+static ssize_t zv_writeback_percent_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", zv_writeback_percent);
+}
+
+static ssize_t zv_writeback_percent_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || (val > 150))
+		return -EINVAL;
+	zv_writeback_percent = val;
+	return count;
+}
+
+static struct kobj_attribute zcache_zv_writeback_percent_attr = {
+		.attr = { .name = "zv_writeback_percent", .mode = 0644 },
+		.show = zv_writeback_percent_show,
+		.store = zv_writeback_percent_store,
+};
+#endif
+
 static struct kobj_attribute zcache_zv_max_zsize_attr = {
 		.attr = { .name = "zv_max_zsize", .mode = 0644 },
 		.show = zv_max_zsize_show,
@@ -1211,6 +1333,7 @@ static void *zcache_pampd_create(char *data, size_t size, bool raw, int eph,
 		count = atomic_inc_return(&zcache_curr_pers_pampd_count);
 		if (count > zcache_curr_pers_pampd_count_max)
 			zcache_curr_pers_pampd_count_max = count;
+		zv_writeback_kick(count);
 	}
 out:
 	return pampd;
@@ -1228,6 +1351,7 @@ static int zcache_pampd_get_data(char *data, size_t *bufsize, bool raw,
 
 	BUG_ON(is_ephemeral(pool));
 	zv_decompress((struct page *)(data), pampd);
+	zv_lru_touch(pampd);
 	return ret;
 }
 
@@ -1427,6 +1551,10 @@ ZCACHE_SYSFS_RO(aborted_preload);
 ZCACHE_SYSFS_RO(aborted_shrink);
 ZCACHE_SYSFS_RO(compress_poor);
 ZCACHE_SYSFS_RO(mean_compress_poor);
+#ifdef CONFIG_ZCACHE_WRITEBACK
+ZCACHE_SYSFS_RO(writeback_pages);
+ZCACHE_SYSFS_RO(writeback_skipped);
+#endif
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_raw_pages);
 ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zpages);
 ZCACHE_SYSFS_RO_ATOMIC(curr_obj_count);
@@ -1475,6 +1603,11 @@ static struct attribute *zcache_attrs[] = {
 	&zcache_zv_max_zsize_attr.attr,
 	&zcache_zv_max_mean_zsize_attr.attr,
 	&zcache_zv_page_count_policy_percent_attr.attr,
+#ifdef CONFIG_ZCACHE_WRITEBACK
+	&zcache_zv_writeback_percent_attr.attr,
+	&zcache_writeback_pages_attr.attr,
+	&zcache_writeback_skipped_attr.attr,
+#endif
 	NULL,
 };
 
@@ -1897,6 +2030,110 @@ struct frontswap_ops zcache_frontswap_register_ops(void)
 }
 #endif
 
+#ifdef CONFIG_ZCACHE_WRITEBACK
+/*
+ * Write the least recently used persistent page back to its slot on the
+ * swap device.  The page is brought into the swap cache the same way a
+ * swapin would, which decompresses it through frontswap, then the
+ * compressed copy is flushed and the page is written to the device with
+ * frontswap bypassed.  Holding the swap cache page locked keeps any
+ * concurrent swapin or swapout of the same entry out until we are done.
+ *
+ * Returns 1 if a page was written back, 0 if the page picked was skipped
+ * and -1 if there are no persistent pages left.
+ */
+static int zv_writeback_one(void)
+{
+	struct zv_hdr *zv;
+	struct tmem_oid oid;
+	uint32_t pool_id, index;
+	unsigned type;
+	pgoff_t offset;
+	swp_entry_t entry;
+	struct page *page;
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_NONE,
+	};
+
+	spin_lock_irq(&zv_lru_lock);
+	if (list_empty(&zv_lru)) {
+		spin_unlock_irq(&zv_lru_lock);
+		return -1;
+	}
+	zv = list_entry(zv_lru.prev, struct zv_hdr, lru);
+	pool_id = zv->pool_id;
+	oid = zv->oid;
+	index = zv->index;
+	/* rotate it so a page we fail to write isn't picked again at once */
+	list_move(&zv->lru, &zv_lru);
+	spin_unlock_irq(&zv_lru_lock);
+
+	if (pool_id != zcache_frontswap_poolid)
+		goto skip;
+	type = oid.oid[0] >> SWIZ_BITS;
+	offset = ((pgoff_t)index << SWIZ_BITS) | (oid.oid[0] & SWIZ_MASK);
+	entry = swp_entry(type, offset);
+
+	/* already back in the swap cache, so not cold after all */
+	page = find_get_page(&swapper_space, entry.val);
+	if (page != NULL) {
+		page_cache_release(page);
+		goto skip;
+	}
+	/* fails if the swap entry was freed since we looked at the lru */
+	page = read_swap_cache_async(entry, GFP_KERNEL, NULL, 0);
+	if (page == NULL)
+		goto skip;
+	lock_page(page);
+	if (!PageSwapCache(page) || page_private(page) != entry.val ||
+	    !PageUptodate(page) || PageDirty(page) || PageWriteback(page) ||
+	    page_mapped(page) || !frontswap_test(swap_info[type], offset)) {
+		unlock_page(page);
+		page_cache_release(page);
+		goto skip;
+	}
+	frontswap_flush_page(type, offset);
+	/* have reclaim drop the page as soon as the write completes */
+	SetPageReclaim(page);
+	__swap_writepage(page, &wbc);
+	page_cache_release(page);
+	zcache_writeback_pages++;
+	return 1;
+skip:
+	zcache_writeback_skipped++;
+	return 0;
+}
+
+/*
+ * Write back a batch of pages under one plug so adjacent slots go down
+ * as merged bios, and requeue while we are making progress.  Writeback
+ * stops 1/16th below the limit so it isn't kicked again by the next put.
+ */
+static void zv_writeback_work(struct work_struct *work)
+{
+	struct blk_plug plug;
+	unsigned long limit = zv_writeback_limit();
+	int i, ret, written = 0;
+
+	/* disabled since we were queued */
+	if (zv_writeback_percent == 0)
+		return;
+	limit -= limit / 16;
+	blk_start_plug(&plug);
+	for (i = 0; i < ZV_WRITEBACK_BATCH; i++) {
+		if (atomic_read(&zcache_curr_pers_pampd_count) <= limit)
+			break;
+		ret = zv_writeback_one();
+		if (ret < 0)
+			break;
+		written += ret;
+	}
+	blk_finish_plug(&plug);
+	if (written && atomic_read(&zcache_curr_pers_pampd_count) > limit)
+		queue_work(zv_writeback_wq, &zv_writeback);
+}
+#endif
+
 /*
  * zcache initialization
  * NOTE FOR NOW zcache MUST BE PROVIDED AS A KERNEL BOOT PARAMETER OR
@@ -1994,6 +2231,12 @@ static int __init zcache_init(void)
 			"transcendent memory and xvmalloc\n");
 		if (old_ops.init != NULL)
 			pr_warning("ktmem: frontswap_ops overridden");
+#ifdef CONFIG_ZCACHE_WRITEBACK
+		zv_writeback_wq = create_singlethread_workqueue("zcache_wb");
+		if (zv_writeback_wq == NULL)
+			pr_warning("zcache: writeback disabled, "
+				"can't create workqueue\n");
+#endif
 	}
 #endif
 out:
@@ -0,0 +1,279 @@
+/*
+ * Compressed RAM block device - compression streams
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/err.h>
+#include <linux/crypto.h>
+
+#include "zcomp.h"
+
+/* shown in comp_algorithm, any crypto compressor can be selected */
+static const char * const backends[] = {
+	"lzo",
+	"lz4",
+	NULL
+};
+
+int zcomp_available_algorithm(const char *comp)
+{
+	return crypto_has_comp(comp, 0, 0);
+}
+
+/* List the known algorithms that are available, the current in [] */
+ssize_t zcomp_available_show(const char *comp, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (!zcomp_available_algorithm(backends[i]))
+			continue;
+		if (!strcmp(comp, backends[i]))
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"[%s] ", backends[i]);
+		else
+			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+					"%s ", backends[i]);
+	}
+	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+
+	return sz;
+}
+
+static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	if (!IS_ERR_OR_NULL(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	/* worst case compressed size is a bit over one page */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zcomp_strm_free(comp, zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/*
+ * Streams are only allocated here, from process context, and never by
+ * the write path: allocating a transform may enter reclaim, which must
+ * not recurse into swapping to zram itself.
+ */
+static int zcomp_strm_fill(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	spin_lock(&comp->strm_lock);
+	while (comp->avail_strm < comp->max_strm) {
+		comp->avail_strm++;
+		spin_unlock(&comp->strm_lock);
+
+		zstrm = zcomp_strm_alloc(comp);
+
+		spin_lock(&comp->strm_lock);
+		if (!zstrm) {
+			comp->avail_strm--;
+			spin_unlock(&comp->strm_lock);
+			return -ENOMEM;
+		}
+		list_add(&zstrm->list, &comp->idle_strm);
+	}
+	spin_unlock(&comp->strm_lock);
+	wake_up_all(&comp->strm_wait);
+
+	return 0;
+}
+
+/* Get an idle stream, sleeping until another writer releases one */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_entry(comp->idle_strm.next,
+					struct zcomp_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+		spin_unlock(&comp->strm_lock);
+
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	if (comp->avail_strm <= comp->max_strm) {
+		list_add(&zstrm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+		return;
+	}
+
+	comp->avail_strm--;
+	spin_unlock(&comp->strm_lock);
+	zcomp_strm_free(comp, zstrm);
+}
+
+/*
+ * Streams in use above the new limit are freed as they are released,
+ * idle ones right away. A raised limit is filled up right away.
+ */
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm)
+{
+	struct zcomp_strm *zstrm;
+
+	spin_lock(&comp->strm_lock);
+	comp->max_strm = num_strm;
+	while (comp->avail_strm > num_strm && !list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+		zcomp_strm_free(comp, zstrm);
+		spin_lock(&comp->strm_lock);
+	}
+	spin_unlock(&comp->strm_lock);
+
+	/* keep what could be allocated, there is at least one stream */
+	return zcomp_strm_fill(comp);
+}
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len)
+{
+	/* the stream buffer is two pages */
+	unsigned int dlen = PAGE_SIZE * 2;
+	int ret;
+
+	ret = crypto_comp_compress(zstrm->tfm, src, PAGE_SIZE,
+				   zstrm->buffer, &dlen);
+	*dst_len = dlen;
+
+	return ret;
+}
+
+/*
+ * Decompression does not take a stream: readers run with the slot lock
+ * held and can't sleep waiting for one. Every cpu has a transform of
+ * its own instead, which is safe to use since preemption is disabled.
+ */
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst)
+{
+	unsigned int dlen = PAGE_SIZE;
+	struct crypto_comp *tfm;
+	int ret;
+
+	tfm = *per_cpu_ptr(comp->dtfm, get_cpu());
+	ret = crypto_comp_decompress(tfm, src, src_len, dst, &dlen);
+	put_cpu();
+
+	return ret;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+	struct crypto_comp *tfm;
+	int cpu;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(comp, zstrm);
+	}
+
+	if (comp->dtfm) {
+		for_each_possible_cpu(cpu) {
+			tfm = *per_cpu_ptr(comp->dtfm, cpu);
+			if (!IS_ERR_OR_NULL(tfm))
+				crypto_free_comp(tfm);
+		}
+		free_percpu(comp->dtfm);
+	}
+	kfree(comp);
+}
+
+/*
+ * @compress is the crypto API name of the compressor, it has to stay
+ * valid for the lifetime of the zcomp.
+ */
+struct zcomp *zcomp_create(const char *compress, int max_strm)
+{
+	struct zcomp *comp;
+	int cpu;
+
+	if (!zcomp_available_algorithm(compress))
+		return NULL;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return NULL;
+
+	comp->name = compress;
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+	comp->max_strm = max_strm;
+
+	comp->dtfm = alloc_percpu(struct crypto_comp *);
+	if (!comp->dtfm)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = crypto_alloc_comp(compress, 0, 0);
+
+		*per_cpu_ptr(comp->dtfm, cpu) = tfm;
+		if (IS_ERR(tfm))
+			goto fail;
+	}
+
+	/* writers need at least one stream to make progress */
+	if (zcomp_strm_fill(comp) && !comp->avail_strm)
+		goto fail;
+
+	return comp;
+
+fail:
+	zcomp_destroy(comp);
+	return NULL;
+}
@@ -0,0 +1,62 @@
+/*
+ * Compressed RAM block device - compression streams
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/types.h>
+#include <linux/crypto.h>
+
+/*
+ * A compression stream: the compressor's working memory plus the buffer
+ * the page is compressed into. Only one writer uses a stream at a time,
+ * so as many pages can be compressed in parallel as there are streams.
+ */
+struct zcomp_strm {
+	/* compressed page, two pages since a page may expand */
+	void *buffer;
+	/* crypto API transform, holds the working memory */
+	struct crypto_comp *tfm;
+	struct list_head list;
+};
+
+struct zcomp {
+	spinlock_t strm_lock;		/* protects idle_strm and counters */
+	struct list_head idle_strm;	/* streams not in use */
+	wait_queue_head_t strm_wait;	/* writers waiting for a stream */
+	int avail_strm;			/* streams allocated */
+	int max_strm;			/* streams allowed */
+	struct crypto_comp * __percpu *dtfm;	/* for decompression */
+	const char *name;		/* crypto API algorithm name */
+};
+
+int zcomp_available_algorithm(const char *comp);
+ssize_t zcomp_available_show(const char *comp, char *buf);
+
+struct zcomp *zcomp_create(const char *compress, int max_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+int zcomp_set_max_streams(struct zcomp *comp, int num_strm);
+
+int zcomp_compress(struct zcomp *comp, struct zcomp_strm *zstrm,
+		const unsigned char *src, size_t *dst_len);
+int zcomp_decompress(struct zcomp *comp, const unsigned char *src,
+		size_t src_len, unsigned char *dst);
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Compressed RAM block device - deduplication
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+/*
+ * Identical pages are stored once. Every stored object is hashed by a
+ * checksum of its uncompressed contents; a write whose checksum matches
+ * an existing object is compared against it (decompressing if needed)
+ * and, if equal, just takes another reference instead of compressing
+ * and allocating.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* pages per hash bucket, on average, for a full disk */
+#define ZRAM_DEDUP_BUCKET_SHIFT	4
+
+static struct kmem_cache *zram_entry_cachep;
+
+static struct zram_hash *zram_dedup_bucket(struct zram *zram, u32 checksum)
+{
+	return &zram->hash[checksum & (zram->hash_size - 1)];
+}
+
+u32 zram_dedup_checksum(unsigned char *mem)
+{
+	return jhash2((const u32 *)mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/* Does the object behind @entry hold the same data as @mem? */
+static int zram_dedup_match(struct zram *zram, struct zcomp_strm *zstrm,
+			struct zram_entry *entry, unsigned char *mem)
+{
+	int match = 0;
+	unsigned char *cmem;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE)
+		match = !memcmp(mem, cmem, PAGE_SIZE);
+	else if (!zcomp_decompress(zram->comp, cmem, entry->len,
+				   zstrm->buffer))
+		match = !memcmp(mem, zstrm->buffer, PAGE_SIZE);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for an object with the same contents as @mem. On success a
+ * reference to it is returned. The stream buffer is used as scratch
+ * space for decompressing candidates.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram,
+			struct zcomp_strm *zstrm, unsigned char *mem,
+			u32 checksum)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, checksum);
+	struct zram_entry *entry, *prev = NULL;
+	struct hlist_node *pos;
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, pos, &hash->head, node) {
+		if (entry->checksum != checksum)
+			continue;
+
+		/* hold it while comparing, outside the bucket lock */
+		entry->refcount++;
+		spin_unlock(&hash->lock);
+
+		if (prev)
+			zram_dedup_put(zram, prev);
+
+		if (zram_dedup_match(zram, zstrm, entry, mem))
+			return entry;
+
+		/*
+		 * Keep the reference until the next candidate is pinned,
+		 * so entry->node stays valid to continue the walk.
+		 */
+		prev = entry;
+		spin_lock(&hash->lock);
+	}
+	spin_unlock(&hash->lock);
+
+	if (prev)
+		zram_dedup_put(zram, prev);
+
+	return NULL;
+}
+
+/*
+ * Make a newly stored object available to later writers. Returns the
+ * entry with one reference, for the slot that stored it.
+ */
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+			u16 len, u32 checksum)
+{
+	struct zram_hash *hash;
+	struct zram_entry *entry;
+
+	entry = kmem_cache_alloc(zram_entry_cachep, GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	hash = zram_dedup_bucket(zram, checksum);
+	spin_lock(&hash->lock);
+	hlist_add_head(&entry->node, &hash->head);
+	spin_unlock(&hash->lock);
+
+	atomic_inc(&zram->stats.dedup_entries);
+	atomic64_add(len, &zram->stats.dedup_size);
+
+	return entry;
+}
+
+/* Drop a reference, freeing the object with the last one */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_hash *hash = zram_dedup_bucket(zram, entry->checksum);
+	int refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		hlist_del(&entry->node);
+	spin_unlock(&hash->lock);
+
+	if (refcount)
+		return;
+
+	atomic_dec(&zram->stats.dedup_entries);
+	atomic64_sub(entry->len, &zram->stats.dedup_size);
+
+	zs_free(zram->mem_pool, entry->handle);
+	kmem_cache_free(zram_entry_cachep, entry);
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	size_t i;
+
+	if (!zram->use_dedup)
+		return 0;
+
+	zram->hash_size = roundup_pow_of_two(max_t(size_t, 1,
+				num_pages >> ZRAM_DEDUP_BUCKET_SHIFT));
+	zram->hash = vzalloc(zram->hash_size * sizeof(*zram->hash));
+	if (!zram->hash) {
+		pr_err("Error allocating dedup hash table\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < zram->hash_size; i++) {
+		spin_lock_init(&zram->hash[i].lock);
+		INIT_HLIST_HEAD(&zram->hash[i].head);
+	}
+
+	return 0;
+}
+
+/* Called after all entries have been put */
+void zram_dedup_fini(struct zram *zram)
+{
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
+
+int zram_dedup_cache_create(void)
+{
+	zram_entry_cachep = kmem_cache_create("zram_entry",
+				sizeof(struct zram_entry), 0, 0, NULL);
+
+	return zram_entry_cachep ? 0 : -ENOMEM;
+}
+
+void zram_dedup_cache_destroy(void)
+{
+	kmem_cache_destroy(zram_entry_cachep);
+}
@@ -0,0 +1,57 @@
+/*
+ * Compressed RAM block device - deduplication
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+
+struct zram;
+struct zcomp_strm;
+
+/*
+ * A stored object shared by all slots holding the same page. With
+ * dedup enabled, table entries point to one of these instead of
+ * holding a zsmalloc handle directly.
+ */
+struct zram_entry {
+	struct hlist_node node;		/* on a zram_hash chain */
+	unsigned long handle;		/* zsmalloc handle */
+	u32 checksum;			/* of the uncompressed page */
+	u16 len;			/* object size, PAGE_SIZE if raw */
+	int refcount;			/* slots using it, bucket lock */
+};
+
+/* Entries are hashed by checksum */
+struct zram_hash {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
+u32 zram_dedup_checksum(unsigned char *mem);
+struct zram_entry *zram_dedup_find(struct zram *zram,
+			struct zcomp_strm *zstrm, unsigned char *mem,
+			u32 checksum);
+struct zram_entry *zram_dedup_new(struct zram *zram, unsigned long handle,
+			u16 len, u32 checksum);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+
+int zram_dedup_cache_create(void);
+void zram_dedup_cache_destroy(void);
+
+#endif
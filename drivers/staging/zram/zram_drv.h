@@ -18,7 +18,9 @@
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
+#include "zcomp.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,20 +28,11 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
+/* Default compression algorithm, see comp_algorithm */
+static const char * const default_compressor = "lzo";
+
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
@@ -50,9 +43,8 @@ static const unsigned default_disksize_perc_ram = 25;
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * NOTE: incompressible pages are stored in the same pool as PAGE_SIZE
+ * objects, so ZS_MAX_ALLOC_SIZE must not be less than PAGE_SIZE.
  */
 
 /*-- End of configurable params */
@@ -71,8 +63,11 @@ enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page is one word repeated, table.element; nothing is allocated */
+	ZRAM_SAME,
+
+	/* Slot lock, see zram_slot_lock() */
+	ZRAM_ACCESS,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -81,10 +76,13 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
+	union {
+		unsigned long handle;	/* zsmalloc handle, 0 if nothing stored */
+		struct zram_entry *entry;	/* instead of handle with dedup */
+		unsigned long element;	/* fill word of a ZRAM_SAME page */
+	};
+	u16 size;	/* object size (excluding header) */
+	unsigned long flags;	/* zram_pageflags, ZRAM_ACCESS is a bit lock */
 } __attribute__((aligned(4)));
 
 struct zram_stats {
@@ -95,20 +93,23 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same filled pages, zero included */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t dedup_entries;	/* no. of objects in the dedup hash */
+	atomic64_t dedup_size;	/* size of those objects */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zcomp *comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	struct rw_semaphore lock; /* held for read by all I/O, for write by
+				   * reset; table entries are protected by
+				   * their own ZRAM_ACCESS bit lock */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -120,6 +121,16 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+	/* number of pages that can be compressed at the same time */
+	int max_comp_streams;
+	/* crypto API compressor, set before init */
+	char compressor[CRYPTO_MAX_ALG_NAME];
+
+	/* share identical pages, set before init */
+	int use_dedup;
+	struct zram_hash *hash;
+	size_t hash_size;
+
 	struct zram_stats stats;
 };
 
@@ -0,0 +1,712 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Size class allocator for compressed pages.
+ *
+ * Every allocation is rounded up to one of ZS_SIZE_CLASSES object sizes
+ * and served from a zspage of that class. A zspage is a few order-0
+ * (possibly highmem) pages that are not contiguous; objects are packed
+ * back to back and may straddle a page boundary. Straddling objects are
+ * copied through a per-cpu buffer by zs_map_object().
+ *
+ * Users get a handle, not an address, so compaction can migrate objects
+ * out of sparsely used zspages into fuller ones of the same class and
+ * give the emptied pages back. Compaction runs from the pool's shrinker
+ * and whenever the user calls zs_compact().
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cachep;
+
+/* per-cpu bounce buffer for objects that straddle two pages */
+struct mapping_area {
+	char *vm_buf;		/* copy of a straddling object */
+	char *vm_addr;		/* kmap address, NULL when using vm_buf */
+	enum zs_mapmode vm_mm;
+	struct zspage *zspage;
+	unsigned long off;
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the zspage size, up to ZS_MAX_PAGES_PER_ZSPAGE pages, that wastes
+ * the smallest fraction of its space for objects of the given size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size = i * PAGE_SIZE;
+		int waste = zspage_size % class_size;
+		int usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	unsigned int inuse = zspage->inuse;
+	unsigned int max = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max)
+		return ZS_FULL;
+	if (inuse * ZS_ALMOST_FULL_DEN <= max * ZS_ALMOST_FULL_NUM)
+		return ZS_ALMOST_EMPTY;
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+			enum fullness_group fg)
+{
+	zspage->fullness = fg;
+	if (fg >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+
+	list_add(&zspage->list, &class->fullness_list[fg]);
+	class->nr_zspages[fg]++;
+}
+
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	int fg = zspage->fullness;
+
+	if (fg >= _ZS_NR_FULLNESS_GROUPS)
+		return;
+
+	list_del_init(&zspage->list);
+	class->nr_zspages[fg]--;
+}
+
+/*
+ * Move the zspage to the list matching its current use. Returns the
+ * new group; the caller frees the zspage if it became ZS_EMPTY.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+			struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(zspage);
+
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	remove_zspage(class, zspage);
+	insert_zspage(class, zspage, newfg);
+
+	return newfg;
+}
+
+/* Allocation fills almost full zspages first to keep the others drainable */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int fg;
+
+	for (fg = ZS_ALMOST_FULL; fg <= ZS_ALMOST_EMPTY; fg++) {
+		if (!list_empty(&class->fullness_list[fg]))
+			return list_first_entry(&class->fullness_list[fg],
+					struct zspage, list);
+	}
+
+	return NULL;
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+			struct size_class *class)
+{
+	struct zspage *zspage;
+	unsigned int i;
+
+	zspage = kzalloc(sizeof(*zspage) +
+			class->objs_per_zspage * sizeof(zspage->slots[0]),
+			pool->flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(pool->flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	for (i = 0; i < class->objs_per_zspage; i++)
+		zspage->slots[i] = ZS_SLOT_FREE(i + 1);
+
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	unsigned int i;
+
+	for (i = 0; i < zspage->class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+}
+
+static unsigned int obj_alloc(struct zspage *zspage, struct zs_handle *handle)
+{
+	unsigned int idx = zspage->freeidx;
+
+	zspage->freeidx = ZS_SLOT_NEXT(zspage->slots[idx]);
+	zspage->slots[idx] = (unsigned long)handle;
+	zspage->inuse++;
+
+	handle->zspage = zspage;
+	handle->idx = idx;
+
+	return idx;
+}
+
+static void obj_free(struct zspage *zspage, unsigned int idx)
+{
+	zspage->slots[idx] = ZS_SLOT_FREE(zspage->freeidx);
+	zspage->freeidx = idx;
+	zspage->inuse--;
+}
+
+/*
+ * Copy @len bytes between @buf and the zspage, starting at byte @off of
+ * the zspage and crossing page boundaries as needed.
+ */
+static void zs_copy_obj(struct zspage *zspage, unsigned long off,
+			char *buf, int len, int to_obj)
+{
+	while (len) {
+		unsigned int pgoff = off & ~PAGE_MASK;
+		int n = min_t(int, len, PAGE_SIZE - pgoff);
+		char *addr;
+
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		if (to_obj)
+			memcpy(addr + pgoff, buf, n);
+		else
+			memcpy(buf, addr + pgoff, n);
+		kunmap_atomic(addr, KM_USER1);
+
+		off += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Move one object between two zspages of the same class */
+static void zs_move_obj(struct size_class *class, struct zspage *dst,
+			unsigned int didx, struct zspage *src, unsigned int sidx)
+{
+	unsigned long doff = (unsigned long)didx * class->size;
+	unsigned long soff = (unsigned long)sidx * class->size;
+	int len = class->size;
+
+	while (len) {
+		unsigned int dpgoff = doff & ~PAGE_MASK;
+		unsigned int spgoff = soff & ~PAGE_MASK;
+		int n = min3(len, (int)(PAGE_SIZE - dpgoff),
+				(int)(PAGE_SIZE - spgoff));
+		char *saddr, *daddr;
+
+		saddr = kmap_atomic(src->pages[soff >> PAGE_SHIFT], KM_USER0);
+		daddr = kmap_atomic(dst->pages[doff >> PAGE_SHIFT], KM_USER1);
+		memcpy(daddr + dpgoff, saddr + spgoff, n);
+		kunmap_atomic(daddr, KM_USER1);
+		kunmap_atomic(saddr, KM_USER0);
+
+		doff += n;
+		soff += n;
+		len -= n;
+	}
+}
+
+/**
+ * zs_malloc - allocate an object from the pool
+ * @pool: pool to allocate from
+ * @size: size of the object, at most ZS_MAX_ALLOC_SIZE
+ *
+ * Returns a handle to the object or 0 on failure. May sleep if the
+ * pool flags allow it.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	struct zs_handle *handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = kmem_cache_zalloc(zs_handle_cachep,
+				pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+
+		zspage = alloc_zspage(pool, class);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cachep, handle);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+
+		spin_lock(&class->lock);
+	}
+
+	obj_alloc(zspage, handle);
+	class->objs_inuse++;
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long obj)
+{
+	struct zs_handle *handle = (struct zs_handle *)obj;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+
+	if (unlikely(!handle))
+		return;
+
+	/* keep compaction from moving the object under us */
+	bit_spin_lock(HANDLE_PIN_BIT, &handle->flags);
+	zspage = handle->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(zspage, handle->idx);
+	class->objs_inuse--;
+	fg = fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+	bit_spin_unlock(HANDLE_PIN_BIT, &handle->flags);
+
+	if (fg == ZS_EMPTY) {
+		free_zspage(zspage);
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+	}
+
+	kmem_cache_free(zs_handle_cachep, handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get a pointer to an object
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ * @mm: what the caller is going to do with the object
+ *
+ * The object stays pinned, and preemption disabled, until
+ * zs_unmap_object(). Only one object can be mapped per cpu at a time.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct mapping_area *area;
+	struct size_class *class;
+	struct zspage *zspage;
+	unsigned long off;
+	unsigned int pgoff;
+
+	bit_spin_lock(HANDLE_PIN_BIT, &h->flags);
+
+	zspage = h->zspage;
+	class = zspage->class;
+	off = (unsigned long)h->idx * class->size;
+	pgoff = off & ~PAGE_MASK;
+
+	area = &__get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+
+	if (pgoff + class->size <= PAGE_SIZE) {
+		/* object lives in a single page */
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER1);
+		return area->vm_addr + pgoff;
+	}
+
+	area->vm_addr = NULL;
+	area->zspage = zspage;
+	area->off = off;
+	if (mm != ZS_MM_WO)
+		zs_copy_obj(zspage, off, area->vm_buf, class->size, 0);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct mapping_area *area;
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr)
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	else if (area->vm_mm != ZS_MM_RO)
+		zs_copy_obj(area->zspage, area->off, area->vm_buf,
+			    area->zspage->class->size, 1);
+
+	bit_spin_unlock(HANDLE_PIN_BIT, &h->flags);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/* ------------------------ compaction ------------------------ */
+
+/* Number of zspages that compacting this class could free */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long capacity, zspages = 0;
+	int fg;
+
+	for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+		zspages += class->nr_zspages[fg];
+
+	capacity = zspages * class->objs_per_zspage;
+	if (capacity <= class->objs_inuse)
+		return 0;
+
+	return (capacity - class->objs_inuse) / class->objs_per_zspage;
+}
+
+static struct zspage *isolate_zspage(struct size_class *class,
+			enum fullness_group fg)
+{
+	struct zspage *zspage;
+
+	if (list_empty(&class->fullness_list[fg]))
+		return NULL;
+
+	zspage = list_first_entry(&class->fullness_list[fg],
+				struct zspage, list);
+	remove_zspage(class, zspage);
+	zspage->fullness = ZS_ISOLATED;
+
+	return zspage;
+}
+
+/*
+ * Move objects from @src to @dst until one of them runs out. Returns
+ * -EBUSY if an object is pinned, in which case @src can't be emptied
+ * right now.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *dst,
+			struct zspage *src)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		unsigned long slot = src->slots[idx];
+		struct zs_handle *handle;
+		unsigned int didx;
+
+		if (ZS_SLOT_IS_FREE(slot))
+			continue;
+
+		if (dst->inuse == class->objs_per_zspage)
+			return 0;
+
+		handle = (struct zs_handle *)slot;
+		if (!bit_spin_trylock(HANDLE_PIN_BIT, &handle->flags))
+			return -EBUSY;
+
+		didx = obj_alloc(dst, handle);
+		zs_move_obj(class, dst, didx, src, idx);
+		obj_free(src, idx);
+		bit_spin_unlock(HANDLE_PIN_BIT, &handle->flags);
+
+		class->migrated++;
+	}
+
+	return 0;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+			struct size_class *class)
+{
+	struct zspage *src, *dst;
+	unsigned long freed = 0;
+	int ret = 0;
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class)) {
+		src = isolate_zspage(class, ZS_ALMOST_EMPTY);
+		if (!src)
+			break;
+
+		while (src->inuse) {
+			dst = isolate_zspage(class, ZS_ALMOST_FULL);
+			if (!dst)
+				dst = isolate_zspage(class, ZS_ALMOST_EMPTY);
+			if (!dst)
+				break;
+
+			ret = migrate_zspage(class, dst, src);
+			fix_fullness_group(class, dst);
+			if (ret)
+				break;
+		}
+
+		/* pinned object or no room left, put it back and stop */
+		if (fix_fullness_group(class, src) != ZS_EMPTY)
+			break;
+
+		spin_unlock(&class->lock);
+		free_zspage(src);
+		freed += class->pages_per_zspage;
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - release sparsely used zspages
+ * @pool: pool to compact
+ *
+ * Returns the number of pages given back to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	int i;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		freed += zs_compact_class(pool, pool->size_class[i]);
+
+	atomic_long_sub(freed, &pool->pages_allocated);
+	atomic_long_add(freed, &pool->pages_compacted);
+
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static int zs_shrinker_func(struct shrinker *shrinker,
+			struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					shrinker);
+	unsigned long freeable = 0;
+	int i;
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		spin_lock(&class->lock);
+		freeable += zs_can_compact(class) * class->pages_per_zspage;
+		spin_unlock(&class->lock);
+	}
+
+	return min_t(unsigned long, freeable, INT_MAX);
+}
+
+/* ------------------------ pool ------------------------ */
+
+/**
+ * zs_create_pool - create a pool
+ * @name: name of the pool, for messages
+ * @flags: allocation flags for the backing pages, __GFP_HIGHMEM is fine
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	struct zs_pool *pool;
+	int i, fg;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class;
+
+		class = kzalloc(sizeof(*class), GFP_KERNEL);
+		if (!class)
+			goto fail;
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->index = i;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+
+		pool->size_class[i] = class;
+	}
+
+	pool->name = name;
+	pool->flags = flags;
+
+	pool->shrinker.shrink = zs_shrinker_func;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+
+fail:
+	while (i--)
+		kfree(pool->size_class[i]);
+	kfree(pool);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i, fg;
+
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (list_empty(&class->fullness_list[fg]))
+				continue;
+			pr_info("Freeing non-empty class with size %ub, fullness group %d\n",
+				class->size, fg);
+		}
+		kfree(class);
+	}
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+u64 zs_get_compacted_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_compacted_pages);
+
+int zs_get_num_classes(void)
+{
+	return ZS_SIZE_CLASSES;
+}
+EXPORT_SYMBOL_GPL(zs_get_num_classes);
+
+void zs_get_class_stats(struct zs_pool *pool, int class_idx,
+			struct zs_class_stats *stats)
+{
+	struct size_class *class = pool->size_class[class_idx];
+
+	spin_lock(&class->lock);
+	stats->size = class->size;
+	stats->pages_per_zspage = class->pages_per_zspage;
+	stats->objs_per_zspage = class->objs_per_zspage;
+	stats->almost_full = class->nr_zspages[ZS_ALMOST_FULL];
+	stats->almost_empty = class->nr_zspages[ZS_ALMOST_EMPTY];
+	stats->full = class->nr_zspages[ZS_FULL];
+	stats->zspages = stats->almost_full + stats->almost_empty +
+			stats->full;
+	stats->objs_inuse = class->objs_inuse;
+	stats->objs_capacity = stats->zspages * class->objs_per_zspage;
+	stats->migrated = class->migrated;
+	spin_unlock(&class->lock);
+}
+EXPORT_SYMBOL_GPL(zs_get_class_stats);
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	zs_handle_cachep = kmem_cache_create("zs_handle",
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+	kmem_cache_destroy(zs_handle_cachep);
+	return -ENOMEM;
+}
+subsys_initcall(zs_init);
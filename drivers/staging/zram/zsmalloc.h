@@ -0,0 +1,64 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+/*
+ * Objects are referred to by an opaque handle rather than by their
+ * address, so the allocator is free to move them around (compaction).
+ * Use zs_map_object() to get at the contents.
+ */
+
+enum zs_mapmode {
+	ZS_MM_RW,	/* read and write */
+	ZS_MM_RO,	/* read only, no copy back */
+	ZS_MM_WO,	/* write only, no copy in */
+};
+
+struct zs_pool;
+
+/* per size class statistics, see zs_get_class_stats() */
+struct zs_class_stats {
+	unsigned int size;		/* object size of the class */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+	unsigned long zspages;		/* zspages allocated */
+	unsigned long objs_inuse;	/* objects allocated */
+	unsigned long objs_capacity;	/* objects the zspages can hold */
+	unsigned long almost_empty;	/* zspages at most 3/4 used */
+	unsigned long almost_full;	/* zspages more than 3/4 used */
+	unsigned long full;		/* zspages without free objects */
+	u64 migrated;			/* objects moved by compaction */
+};
+
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags);
+void zs_destroy_pool(struct zs_pool *pool);
+
+unsigned long zs_malloc(struct zs_pool *pool, size_t size);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm);
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
+
+unsigned long zs_compact(struct zs_pool *pool);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+u64 zs_get_compacted_pages(struct zs_pool *pool);
+int zs_get_num_classes(void);
+void zs_get_class_stats(struct zs_pool *pool, int class_idx,
+			struct zs_class_stats *stats);
+
+#endif
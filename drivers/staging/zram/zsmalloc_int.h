@@ -0,0 +1,123 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/shrinker.h>
+#include <linux/atomic.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a set of up to ZS_MAX_PAGES_PER_ZSPAGE order-0 pages
+ * which together hold objects of one size class. Objects may cross
+ * page boundaries, which is what lets larger classes waste less than
+ * a page worth of tail space.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+/* End of user params */
+
+/*
+ * zspages are kept on lists by how full they are. Allocation prefers
+ * almost full zspages, compaction empties almost empty ones into the
+ * others. Empty zspages are freed right away.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+	ZS_ISOLATED,		/* taken off the lists by compaction */
+};
+
+/* zspage is almost empty when at most this fraction of it is used */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+struct size_class;
+struct zspage;
+
+/*
+ * Handles point to one of these. The location changes when compaction
+ * moves the object; HANDLE_PIN_BIT keeps it from doing so while the
+ * object is mapped or being freed.
+ */
+struct zs_handle {
+	unsigned long flags;
+	struct zspage *zspage;
+	unsigned int idx;
+};
+
+#define HANDLE_PIN_BIT		0
+
+/*
+ * Free slots hold the index of the next free slot, tagged with the low
+ * bit which is never set in a (word aligned) handle pointer.
+ */
+#define ZS_SLOT_FREE(next)	(((unsigned long)(next) << 1) | 1)
+#define ZS_SLOT_IS_FREE(slot)	((slot) & 1)
+#define ZS_SLOT_NEXT(slot)	((slot) >> 1)
+
+struct zspage {
+	struct list_head list;		/* on a class fullness list */
+	struct size_class *class;
+	unsigned int inuse;		/* objects allocated */
+	unsigned int freeidx;		/* first free slot */
+	int fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned long slots[0];		/* handle or free slot link */
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	unsigned long nr_zspages[_ZS_NR_FULLNESS_GROUPS];
+
+	unsigned int size;
+	unsigned int index;
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	unsigned long objs_inuse;
+	u64 migrated;
+};
+
+struct zs_pool {
+	const char *name;
+	gfp_t flags;	/* allocation flags used for zspage pages */
+
+	struct size_class *size_class[ZS_SIZE_CLASSES];
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	/* compact when the VM asks for memory */
+	struct shrinker shrinker;
+};
+
+#endif
@@ -22,13 +22,16 @@
 
 #include <linux/clk.h>
 #include <linux/cpu.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/err.h>
 #include <linux/earlysuspend.h>
 #include <linux/io.h>
 #include <linux/td_framework.h>
 #include <linux/tdf_hotplug.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/workqueue.h>
 
 enum {
@@ -47,6 +50,7 @@ static DEFINE_PER_CPU(struct tripndroid_hp_cpudata_t, tripndroid_hp_cpudata);
 static DEFINE_MUTEX(tripndroid_hp_cpu_lock);
 
 struct delayed_work tripndroid_hp_w;
+static struct work_struct tripndroid_hp_event_w;
 
 static struct tripndroid_hp {
 	unsigned int sample_ms;
@@ -87,6 +91,34 @@ static unsigned int powersaving_thresholds[] = {
 static unsigned int NwNs_Threshold[8] = {12, 0, 20, 7, 25, 10, 0, 18};
 static unsigned int TwTs_Threshold[8] = {140, 0, 140, 190, 140, 190, 0, 190};
 
+/*
+ * event mode: the scheduler fires a trigger as soon as the number of
+ * runnable threads crosses the up threshold for the current number of
+ * online cpus, periodic sampling is kept for the down path and as a
+ * fallback. Off until the trigger level is tuned per device.
+ */
+static bool event_mode = false;
+module_param(event_mode, bool, 0644);
+
+/* runnable threads above the up threshold before the trigger fires */
+#define TDF_TRIGGER_HYSTERESIS	1
+
+static u64 tdf_trigger_time;
+static cputime64_t tdf_last_event_up;
+
+/* decision-to-online latency histogram, upper bounds in usecs */
+static const unsigned int tdf_lat_bounds[] = {
+	500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, UINT_MAX
+};
+
+enum {
+	TDF_LAT_EVENT = 0,
+	TDF_LAT_PERIODIC,
+	TDF_LAT_MAX,
+};
+
+static unsigned int tdf_lat_hist[TDF_LAT_MAX][ARRAY_SIZE(tdf_lat_bounds)];
+
 /* get cpu speed */
 unsigned int cpu_getspeed(unsigned int cpu)
 {
@@ -126,6 +158,72 @@ static int get_slowest_cpu(void)
         return cpu;
 }
 
+static void tdf_lat_record(int type, u64 start)
+{
+	unsigned int i;
+	u64 delta = sched_clock() - start;
+
+	do_div(delta, NSEC_PER_USEC);
+
+	for (i = 0; i < ARRAY_SIZE(tdf_lat_bounds) - 1; i++)
+		if (delta < tdf_lat_bounds[i])
+			break;
+
+	tdf_lat_hist[type][i]++;
+}
+
+static void tripndroid_hp_trigger(u64 time)
+{
+	tdf_trigger_time = time;
+	schedule_work(&tripndroid_hp_event_w);
+}
+
+/* the most cpus calculate_load() can ask for in the current mode */
+static unsigned int tdf_max_cpus(void)
+{
+	unsigned int max_cpus = tripndroid_hp_config.max_cpus;
+
+	if (powersaving_active)
+		return min_t(unsigned int, max_cpus,
+			     ARRAY_SIZE(powersaving_thresholds));
+	return min_t(unsigned int, max_cpus, ARRAY_SIZE(normal_thresholds));
+}
+
+/*
+ * Average runnable threads above which calculate_load() asks for more
+ * than @online_cpus, in FSHIFT fixed point like avg_nr_running().
+ * Only valid below tdf_max_cpus().
+ */
+static unsigned int tdf_up_threshold(unsigned int online_cpus)
+{
+	if (powersaving_active)
+		return powersaving_thresholds[online_cpus - 1] << (FSHIFT - 1);
+	return normal_thresholds[online_cpus - 1] << (FSHIFT - 2);
+}
+
+/*
+ * The trigger counts whole runnable threads at an instant, so it is set
+ * TDF_TRIGGER_HYSTERESIS above the averaged threshold, and the event work
+ * still checks the average before bringing a cpu up.
+ */
+static void tripndroid_hp_arm_trigger(void)
+{
+	unsigned int online_cpus = num_online_cpus();
+	unsigned int level;
+
+	if (!event_mode || tdf_suspend_state == 1 ||
+	    state == TRIPNDROID_HP_DISABLED ||
+	    online_cpus >= tdf_max_cpus()) {
+		sched_set_nr_run_trigger(0, NULL);
+		return;
+	}
+
+	level = (tdf_up_threshold(online_cpus) >> FSHIFT) + 1 +
+		TDF_TRIGGER_HYSTERESIS;
+	sched_set_nr_run_trigger(max(level, online_cpus + 1),
+				 tripndroid_hp_trigger);
+}
+
 static unsigned int calculate_load(void)
 {
 	unsigned int avg_nr_run = avg_nr_running();
@@ -275,9 +373,12 @@ static void tripndroid_hp_wt(struct work_struct *work)
                 cpu = cpumask_next_zero(0, cpu_online_mask);
                 if (cpu < nr_cpu_ids) {
                         if ((per_cpu(tripndroid_hp_cpudata, cpu).online == false) && (!cpu_online(cpu))) {
+                                u64 decision_time = sched_clock();
+
                                 cpu_up(cpu);
                                 per_cpu(tripndroid_hp_cpudata, cpu).online = true;
                                 per_cpu(tripndroid_hp_cpudata, cpu).on_time = ktime_to_ms(ktime_get());
+                                tdf_lat_record(TDF_LAT_PERIODIC, decision_time);
                         }
 			else if (per_cpu(tripndroid_hp_cpudata, cpu).online != cpu_online(cpu)) {
 				tdf_pause_timer = ktime_to_ms(ktime_get()) + tripndroid_hp_config.pause;
@@ -288,6 +389,7 @@ static void tripndroid_hp_wt(struct work_struct *work)
 	default:
 		pr_info("TDF: oops! hit an invalid state %d\n", state);
 	}
+	tripndroid_hp_arm_trigger();
 	mutex_unlock(&tripndroid_hp_cpu_lock);
 
 out:
@@ -298,6 +400,100 @@ out:
 	return;
 }
 
+static void tripndroid_hp_event_wt(struct work_struct *work)
+{
+	unsigned int cpu;
+	unsigned int index;
+	unsigned int online_cpus;
+	unsigned int avg, iowait_avg;
+	cputime64_t now = ktime_to_ms(ktime_get());
+
+	if (tdf_suspend_state == 1 || was_paused)
+		return;
+
+	mutex_lock(&tripndroid_hp_cpu_lock);
+
+	online_cpus = num_online_cpus();
+	if (online_cpus >= tdf_max_cpus())
+		goto out;
+
+	/*
+	 * TwTs_Threshold is the minimum time between two event driven up
+	 * decisions, when we are too early the periodic path re-arms us.
+	 */
+	index = (online_cpus - 1) * 2;
+	if (now - tdf_last_event_up < TwTs_Threshold[index])
+		goto out;
+
+	/* a short burst fires the trigger but doesn't move the average */
+	sched_get_nr_running_ewma(&avg, &iowait_avg);
+	if (avg <= tdf_up_threshold(online_cpus))
+		goto out;
+
+	cpu = cpumask_next_zero(0, cpu_online_mask);
+	if (cpu < tdf_max_cpus() &&
+	    per_cpu(tripndroid_hp_cpudata, cpu).online == false) {
+		cpu_up(cpu);
+		per_cpu(tripndroid_hp_cpudata, cpu).online = true;
+		per_cpu(tripndroid_hp_cpudata, cpu).on_time = ktime_to_ms(ktime_get());
+		tdf_lat_record(TDF_LAT_EVENT, tdf_trigger_time);
+		tdf_last_event_up = now;
+	}
+
+	tripndroid_hp_arm_trigger();
+out:
+	mutex_unlock(&tripndroid_hp_cpu_lock);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int tdf_lat_show(struct seq_file *s, void *data)
+{
+	unsigned int i;
+
+	seq_printf(s, "%-10s %-10s %-10s\n", "<usecs", "event", "periodic");
+	for (i = 0; i < ARRAY_SIZE(tdf_lat_bounds); i++) {
+		if (tdf_lat_bounds[i] == UINT_MAX)
+			seq_printf(s, "%-10s ", "inf");
+		else
+			seq_printf(s, "%-10u ", tdf_lat_bounds[i]);
+		seq_printf(s, "%-10u %-10u\n",
+			   tdf_lat_hist[TDF_LAT_EVENT][i],
+			   tdf_lat_hist[TDF_LAT_PERIODIC][i]);
+	}
+
+	return 0;
+}
+
+static int tdf_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tdf_lat_show, inode->i_private);
+}
+
+static const struct file_operations tdf_lat_fops = {
+	.open		= tdf_lat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init tripndroid_hp_debug_init(void)
+{
+	struct dentry *root;
+
+	root = debugfs_create_dir("tdf_hotplug", NULL);
+	if (!root)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency", S_IRUGO, root, NULL,
+				 &tdf_lat_fops)) {
+		debugfs_remove_recursive(root);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_HAS_EARLYSUSPEND
 static void tripndroid_hp_early_suspend(struct early_suspend *handler)
 {
@@ -309,8 +505,11 @@ static void tripndroid_hp_early_suspend(struct early_suspend *handler)
 	if (!tdf_suspend_state) {
 	tdf_suspend_state = 1;
 	}
+	tripndroid_hp_arm_trigger();
 	mutex_unlock(&tripndroid_hp_cpu_lock);
 
+	cancel_work_sync(&tripndroid_hp_event_w);
+
 	for (i = 1; i < CONFIG_NR_CPUS; i++) {
 		if (cpu_online(i))
 			cpu_down(i);
@@ -374,6 +573,11 @@ static int __init tripndroid_hp_init(void)
 
         was_paused = true;
 
+	INIT_WORK(&tripndroid_hp_event_w, tripndroid_hp_event_wt);
+#ifdef CONFIG_DEBUG_FS
+	tripndroid_hp_debug_init();
+#endif
+
 	if (state != TRIPNDROID_HP_DISABLED)
 		INIT_DELAYED_WORK(&tripndroid_hp_w, tripndroid_hp_wt);
 		schedule_delayed_work_on(0, &tripndroid_hp_w, msecs_to_jiffies(sample_ms));
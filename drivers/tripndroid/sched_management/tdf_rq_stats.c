@@ -22,53 +22,175 @@
 #include <linux/percpu.h>
 #include <linux/hrtimer.h>
 #include <linux/sched.h>
+#include <linux/seqlock.h>
 #include <linux/math64.h>
+#include <linux/irq_work.h>
 
-static DEFINE_PER_CPU(u64, nr_prod_sum);
-static DEFINE_PER_CPU(u64, last_time);
-static DEFINE_PER_CPU(u64, nr);
-static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
-static s64 last_get_time;
+/*
+ * Same time constant as the rq average in kernel/sched.c:
+ * 27 ~= 134217728ns = 134.2ms
+ */
+#define NR_EWMA_PERIOD_EXP	27
+#define NR_EWMA_PERIOD		(1 << NR_EWMA_PERIOD_EXP)
+
+/*
+ * Per-cpu accounting. Writers always run under the rq lock of the cpu
+ * they update, so they are already serialised against each other and
+ * the seqcount only has to give readers a consistent snapshot.
+ *
+ * The products are cumulative and never reset by readers, every reader
+ * keeps its own snapshot instead.
+ */
+struct nr_stats {
+	seqcount_t seq;
+	u64 last_time;
+	unsigned long nr;
+	unsigned long nr_iowait;
+	u64 nr_prod_sum;
+	u64 iowait_prod_sum;
+	/* decayed averages, FSHIFT fixed point */
+	unsigned int nr_ewma;
+	unsigned int iowait_ewma;
+} ____cacheline_aligned_in_smp;
+
+static DEFINE_PER_CPU(struct nr_stats, nr_stats);
+
+/* sched_get_nr_running_avg() private window state */
+static DEFINE_PER_CPU(u64, last_nr_prod_sum);
+static DEFINE_PER_CPU(u64, last_iowait_prod_sum);
+static u64 last_get_time;
+
+/* runnable threads trigger, see sched_set_nr_run_trigger() */
+static unsigned int nr_trigger_level;
+static void (*nr_trigger_fn)(u64 time);
+static u64 nr_trigger_time;
+static struct irq_work nr_trigger_work;
+
+static void nr_trigger_check(u64 curr_time);
+
+static inline unsigned int nr_ewma_update(unsigned int ewma,
+					unsigned long nr, u64 delta)
+{
+	s64 nr_scaled = (s64)nr << FSHIFT;
+
+	if (delta > NR_EWMA_PERIOD)
+		return nr_scaled;
+
+	return ewma + (((s64)delta * (nr_scaled - ewma)) >> NR_EWMA_PERIOD_EXP);
+}
+
+/*
+ * Read a consistent snapshot of @cpu's counters, extended up to @now as
+ * if nothing changed since the last update.
+ */
+static void nr_stats_read(int cpu, u64 now, u64 *nr_sum, u64 *iowait_sum,
+			unsigned int *nr_ewma, unsigned int *iowait_ewma)
+{
+	struct nr_stats *st = &per_cpu(nr_stats, cpu);
+	unsigned int seq;
+	u64 delta;
+
+	do {
+		seq = read_seqcount_begin(&st->seq);
+
+		delta = now > st->last_time ? now - st->last_time : 0;
+		*nr_sum = st->nr_prod_sum + st->nr * delta;
+		*iowait_sum = st->iowait_prod_sum + st->nr_iowait * delta;
+		*nr_ewma = nr_ewma_update(st->nr_ewma, st->nr, delta);
+		*iowait_ewma = nr_ewma_update(st->iowait_ewma,
+					st->nr_iowait, delta);
+	} while (read_seqcount_retry(&st->seq, seq));
+}
 
 /**
- * sched_get_nr_running_avg
- * @return: Average nr_running and iowait value since last poll.
- *	    Returns the avg * 100 to return up to two decimal points
- *	    of accuracy.
+ * sched_get_nr_running_avg_iowait
+ * @avg: Average nr_running since the last poll.
+ * @iowait_avg: Average nr_iowait since the last poll.
  *
- * Obtains the average nr_running value since the last poll.
- * This function may not be called concurrently with itself
+ * Both values are returned * 100 to keep two decimal points of accuracy.
+ * Never blocks the scheduler: the per-cpu counters are read locklessly.
+ * The averaging window is shared, so this function may not be called
+ * concurrently with itself. Use sched_get_nr_running_ewma() when several
+ * users need the signal.
  */
-void sched_get_nr_running_avg(int *avg)
+void sched_get_nr_running_avg_iowait(int *avg, int *iowait_avg)
 {
 	int cpu;
 	u64 curr_time = sched_clock();
 	u64 diff = curr_time - last_get_time;
-	u64 tmp_avg = 0;
+	u64 tmp_avg = 0, tmp_iowait = 0;
 
 	*avg = 0;
+	*iowait_avg = 0;
 
 	if (!diff)
 		return;
 
 	last_get_time = curr_time;
-	/* read and reset nr_running counts */
 	for_each_possible_cpu(cpu) {
-		unsigned long flags;
-
-		spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
-		tmp_avg += per_cpu(nr_prod_sum, cpu);
-		tmp_avg += per_cpu(nr, cpu) *
-			(curr_time - per_cpu(last_time, cpu));
-		per_cpu(last_time, cpu) = curr_time;
-		per_cpu(nr_prod_sum, cpu) = 0;
-		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+		u64 nr_sum, iowait_sum;
+		unsigned int nr_ewma, iowait_ewma;
+
+		nr_stats_read(cpu, curr_time, &nr_sum, &iowait_sum,
+				&nr_ewma, &iowait_ewma);
+
+		tmp_avg += nr_sum - per_cpu(last_nr_prod_sum, cpu);
+		tmp_iowait += iowait_sum - per_cpu(last_iowait_prod_sum, cpu);
+		per_cpu(last_nr_prod_sum, cpu) = nr_sum;
+		per_cpu(last_iowait_prod_sum, cpu) = iowait_sum;
 	}
 
 	*avg = (int)div64_u64(tmp_avg * 100, diff);
+	*iowait_avg = (int)div64_u64(tmp_iowait * 100, diff);
+}
+EXPORT_SYMBOL(sched_get_nr_running_avg_iowait);
+
+/**
+ * sched_get_nr_running_avg
+ * @return: Average nr_running value since last poll.
+ *	    Returns the avg * 100 to return up to two decimal points
+ *	    of accuracy.
+ *
+ * Obtains the average nr_running value since the last poll.
+ * This function may not be called concurrently with itself
+ */
+void sched_get_nr_running_avg(int *avg)
+{
+	int iowait_avg;
+
+	sched_get_nr_running_avg_iowait(avg, &iowait_avg);
 }
 EXPORT_SYMBOL(sched_get_nr_running_avg);
 
+/**
+ * sched_get_nr_running_ewma
+ * @avg: Decayed average of nr_running summed over online cpus.
+ * @iowait_avg: Decayed average of nr_iowait summed over online cpus.
+ *
+ * Both in FSHIFT fixed point, like avg_nr_running(). Keeps no state,
+ * so any number of governors may call it concurrently.
+ */
+void sched_get_nr_running_ewma(unsigned int *avg, unsigned int *iowait_avg)
+{
+	int cpu;
+	u64 curr_time = sched_clock();
+
+	*avg = 0;
+	*iowait_avg = 0;
+
+	for_each_online_cpu(cpu) {
+		u64 nr_sum, iowait_sum;
+		unsigned int nr_ewma, iowait_ewma;
+
+		nr_stats_read(cpu, curr_time, &nr_sum, &iowait_sum,
+				&nr_ewma, &iowait_ewma);
+
+		*avg += nr_ewma;
+		*iowait_avg += iowait_ewma;
+	}
+}
+EXPORT_SYMBOL(sched_get_nr_running_ewma);
+
 /**
  * sched_update_nr_prod
  * @cpu: The core id of the nr running driver.
@@ -76,21 +198,90 @@ EXPORT_SYMBOL(sched_get_nr_running_avg);
  * @inc: Whether we are increasing or decreasing the count
  * @return: N/A
  *
- * Update average with latest nr_running value for CPU
+ * Update average with latest nr_running value for CPU.
+ * Called with the rq lock of @cpu held.
  */
 void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc)
 {
-	int diff;
-	s64 curr_time;
-	unsigned long flags;
+	struct nr_stats *st = &per_cpu(nr_stats, cpu);
+	unsigned long nr_iowait = nr_iowait_cpu(cpu);
+	u64 curr_time, diff;
+
+	write_seqcount_begin(&st->seq);
 
-	spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
 	curr_time = sched_clock();
-	diff = curr_time - per_cpu(last_time, cpu);
-	per_cpu(last_time, cpu) = curr_time;
-	per_cpu(nr, cpu) = nr_running + (inc ? 1 : -1);
+	diff = curr_time > st->last_time ? curr_time - st->last_time : 0;
+	st->last_time = curr_time;
+
+	st->nr_prod_sum += nr_running * diff;
+	st->iowait_prod_sum += st->nr_iowait * diff;
+	st->nr_ewma = nr_ewma_update(st->nr_ewma, nr_running, diff);
+	st->iowait_ewma = nr_ewma_update(st->iowait_ewma, st->nr_iowait, diff);
+
+	st->nr = nr_running + (inc ? 1 : -1);
+	st->nr_iowait = nr_iowait;
 
-	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
-	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+	write_seqcount_end(&st->seq);
+
+	if (inc && ACCESS_ONCE(nr_trigger_level))
+		nr_trigger_check(curr_time);
 }
 EXPORT_SYMBOL(sched_update_nr_prod);
+
+static void nr_trigger_work_fn(struct irq_work *work)
+{
+	void (*fn)(u64 time) = ACCESS_ONCE(nr_trigger_fn);
+
+	if (fn)
+		fn(nr_trigger_time);
+}
+
+/**
+ * sched_set_nr_run_trigger
+ * @level: Number of runnable threads, summed over all cpus, that fires
+ *	   the trigger. 0 disarms it.
+ * @fn: Callback, run from hard irq context with the sched_clock() time
+ *	stamp of the crossing.
+ *
+ * The trigger is one-shot: once fired it stays disarmed until it is set
+ * again, so the callback does not have to deal with a flood of events.
+ */
+void sched_set_nr_run_trigger(unsigned int level, void (*fn)(u64 time))
+{
+	nr_trigger_fn = fn;
+	smp_wmb();
+	nr_trigger_level = level;
+}
+EXPORT_SYMBOL(sched_set_nr_run_trigger);
+
+/*
+ * Called from the enqueue path with the rq lock held, so the callback is
+ * bounced through irq_work rather than waking anything up from here.
+ * Only runs while the trigger is armed; the other cpus' counts are read
+ * without their locks, which is fine for a threshold.
+ */
+static void nr_trigger_check(u64 curr_time)
+{
+	unsigned int level = ACCESS_ONCE(nr_trigger_level);
+	unsigned long total = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		total += ACCESS_ONCE(per_cpu(nr_stats, cpu).nr);
+
+	if (total < level)
+		return;
+
+	if (cmpxchg(&nr_trigger_level, level, 0) != level)
+		return;
+
+	nr_trigger_time = curr_time;
+	irq_work_queue(&nr_trigger_work);
+}
+
+static int __init sched_rq_stats_init(void)
+{
+	init_irq_work(&nr_trigger_work, nr_trigger_work_fn);
+	return 0;
+}
+core_initcall(sched_rq_stats_init);
@@ -21,6 +21,7 @@
 #include <linux/seq_file.h>
 
 #include <linux/io.h>
+#include <linux/math64.h>
 
 #include "bus.h"
 #include "dev.h"
@@ -195,6 +196,39 @@ static const struct file_operations nvhost_debug_fops = {
 	.release	= single_release,
 };
 
+static int nvhost_debug_intr_stats_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_master *m = s->private;
+	struct nvhost_intr_stats *stats = &m->intr.stats;
+	u32 irqs = atomic_read(&stats->irqs);
+	u32 per_irq = irqs ? div_u64(stats->waiters * 100, irqs) : 0;
+
+	seq_printf(s, "irqs: %u\n", irqs);
+	seq_printf(s, "passes: %u\n", stats->passes);
+	seq_printf(s, "waiters: %llu\n", stats->waiters);
+	seq_printf(s, "moderated: %u\n", stats->moderated);
+	seq_printf(s, "irqs_per_sec: %u\n", stats->irqs_per_sec);
+	seq_printf(s, "waiters_per_irq: %u.%02u\n",
+			stats->waiters_per_irq_x100 / 100,
+			stats->waiters_per_irq_x100 % 100);
+	seq_printf(s, "waiters_per_irq_total: %u.%02u\n",
+			per_irq / 100, per_irq % 100);
+	return 0;
+}
+
+static int nvhost_debug_intr_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvhost_debug_intr_stats_show,
+			inode->i_private);
+}
+
+static const struct file_operations nvhost_debug_intr_stats_fops = {
+	.open		= nvhost_debug_intr_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void nvhost_debug_init(struct nvhost_master *master)
 {
 	struct dentry *de = debugfs_create_dir("tegra_host", NULL);
@@ -209,6 +243,13 @@ void nvhost_debug_init(struct nvhost_master *master)
 	debugfs_create_u32("trace_cmdbuf", S_IRUGO|S_IWUSR, de,
 			&nvhost_debug_trace_cmdbuf);
 
+	debugfs_create_file("intr_stats", S_IRUGO, de,
+			master, &nvhost_debug_intr_stats_fops);
+	debugfs_create_u32("intr_moderation_thresh_us", S_IRUGO|S_IWUSR, de,
+			&master->intr.moderation_thresh_us);
+	debugfs_create_u32("intr_moderation_delay_us", S_IRUGO|S_IWUSR, de,
+			&master->intr.moderation_delay_us);
+
 	if (nvhost_get_chip_ops()->debug.debug_init)
 		nvhost_get_chip_ops()->debug.debug_init(de);
 
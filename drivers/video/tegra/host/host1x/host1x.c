@@ -37,6 +37,7 @@
 #include "nvhost_acm.h"
 #include "nvhost_channel.h"
 #include "nvhost_job.h"
+#include "nvhost_fence.h"
 
 #define DRIVER_NAME		"host1x"
 
@@ -244,6 +245,35 @@ static int nvhost_ioctl_ctrl_syncpt_read_max(struct nvhost_ctrl_userctx *ctx,
 	return 0;
 }
 
+static int nvhost_ioctl_ctrl_sync_fence_create(struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_sync_fence_create_args *args)
+{
+	int fd;
+
+	fd = nvhost_fence_create_fd(ctx->dev,
+			(struct nvhost_ctrl_sync_fence_info __user *)
+				(uintptr_t)args->pts,
+			args->num_pts);
+	if (fd < 0)
+		return fd;
+
+	args->fence_fd = fd;
+	return 0;
+}
+
+static int nvhost_ioctl_ctrl_sync_fence_merge(struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_sync_fence_merge_args *args)
+{
+	int fd;
+
+	fd = nvhost_fence_merge_fd(ctx->dev, args->fd1, args->fd2);
+	if (fd < 0)
+		return fd;
+
+	args->fence_fd = fd;
+	return 0;
+}
+
 static long nvhost_ctrlctl(struct file *filp,
 	unsigned int cmd, unsigned long arg)
 {
@@ -287,6 +317,12 @@ static long nvhost_ctrlctl(struct file *filp,
 	case NVHOST_IOCTL_CTRL_SYNCPT_READ_MAX:
 		err = nvhost_ioctl_ctrl_syncpt_read_max(priv, (void *)buf);
 		break;
+	case NVHOST_IOCTL_CTRL_SYNC_FENCE_CREATE:
+		err = nvhost_ioctl_ctrl_sync_fence_create(priv, (void *)buf);
+		break;
+	case NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE:
+		err = nvhost_ioctl_ctrl_sync_fence_merge(priv, (void *)buf);
+		break;
 	default:
 		err = -ENOTTY;
 		break;
@@ -371,6 +407,8 @@ static void nvhost_free_resources(struct nvhost_master *host)
 {
 	kfree(host->intr.syncpt);
 	host->intr.syncpt = 0;
+	kfree(host->intr.syncpt_pending);
+	host->intr.syncpt_pending = 0;
 }
 
 static int __devinit nvhost_alloc_resources(struct nvhost_master *host)
@@ -384,8 +422,11 @@ static int __devinit nvhost_alloc_resources(struct nvhost_master *host)
 	host->intr.syncpt = kzalloc(sizeof(struct nvhost_intr_syncpt) *
 				    nvhost_syncpt_nb_pts(&host->syncpt),
 				    GFP_KERNEL);
+	host->intr.syncpt_pending = kzalloc(sizeof(unsigned long) *
+				BITS_TO_LONGS(nvhost_syncpt_nb_pts(&host->syncpt)),
+				GFP_KERNEL);
 
-	if (!host->intr.syncpt) {
+	if (!host->intr.syncpt || !host->intr.syncpt_pending) {
 		/* frees happen in the support removal phase */
 		return -ENOMEM;
 	}
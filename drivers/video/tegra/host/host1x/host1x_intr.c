@@ -32,19 +32,13 @@
 
 static void t20_intr_syncpt_thresh_isr(struct nvhost_intr_syncpt *syncpt);
 
-static void syncpt_thresh_cascade_fn(struct work_struct *work)
-{
-	struct nvhost_intr_syncpt *sp =
-		container_of(work, struct nvhost_intr_syncpt, work);
-	nvhost_syncpt_thresh_fn(sp->irq, sp);
-}
-
 static irqreturn_t syncpt_thresh_cascade_isr(int irq, void *dev_id)
 {
 	struct nvhost_master *dev = dev_id;
 	void __iomem *sync_regs = dev->sync_aperture;
 	struct nvhost_intr *intr = &dev->intr;
 	unsigned long reg;
+	bool wake = false;
 	int i, id;
 
 	for (i = 0; i < dev->info.nb_pts / BITS_PER_LONG; i++) {
@@ -56,30 +50,33 @@ static irqreturn_t syncpt_thresh_cascade_isr(int irq, void *dev_id)
 				intr->syncpt + (i * BITS_PER_LONG + id);
 			if (sp->irq_requested) {
 				t20_intr_syncpt_thresh_isr(sp);
-				queue_work(intr->wq, &sp->work);
+				set_bit(sp->id, intr->syncpt_pending);
+				wake = true;
 			}
 		}
 	}
 
-	return IRQ_HANDLED;
+	if (!wake)
+		return IRQ_HANDLED;
+
+	atomic_inc(&intr->stats.irqs);
+	return IRQ_WAKE_THREAD;
 }
 
 static void t20_intr_init_host_sync(struct nvhost_intr *intr)
 {
 	struct nvhost_master *dev = intr_to_dev(intr);
 	void __iomem *sync_regs = dev->sync_aperture;
-	int i, err;
+	int err;
 
 	writel(0xffffffffUL,
 		sync_regs + host1x_sync_syncpt_thresh_int_disable_r());
 	writel(0xffffffffUL,
 		sync_regs + host1x_sync_syncpt_thresh_cpu0_int_status_r());
 
-	for (i = 0; i < dev->info.nb_pts; i++)
-		INIT_WORK(&intr->syncpt[i].work, syncpt_thresh_cascade_fn);
-
-	err = request_irq(INT_HOST1X_MPCORE_SYNCPT,
+	err = request_threaded_irq(INT_HOST1X_MPCORE_SYNCPT,
 				syncpt_thresh_cascade_isr,
+				nvhost_syncpt_thresh_fn,
 				IRQF_SHARED, "host_syncpt", dev);
 	if (err)
 		BUG();
@@ -263,7 +260,6 @@ static int t20_free_syncpt_irq(struct nvhost_intr *intr)
 {
 	struct nvhost_master *dev = intr_to_dev(intr);
 	free_irq(INT_HOST1X_MPCORE_SYNCPT, dev);
-	flush_workqueue(intr->wq);
 	return 0;
 }
 
@@ -0,0 +1,326 @@
+/*
+ * drivers/video/tegra/host/nvhost_fence.c
+ *
+ * Tegra Graphics Host Sync Point Fences
+ *
+ * Copyright (c) 2012, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/nvhost_ioctl.h>
+
+#include "nvhost_fence.h"
+#include "nvhost_acm.h"
+#include "nvhost_intr.h"
+#include "nvhost_syncpt.h"
+#include "dev.h"
+
+struct nvhost_fence_pt {
+	u32 id;
+	u32 thresh;
+	void *ref;
+};
+
+/* how often an armed fence checks whether anyone still polls it */
+#define NVHOST_FENCE_IDLE_CHECK	msecs_to_jiffies(100)
+
+/*
+ * A fence is armed on the first poll: it then holds one interrupt waiter
+ * per sync point that had not yet expired. 'pending' counts the waiters
+ * that have not fired plus one bias reference dropped once arming is done;
+ * while it is non-zero the fence also holds a busy reference on host1x so
+ * that the threshold interrupts stay armed. An armed fence that nobody
+ * polls any more is disarmed by idle_work, and armed again by the next
+ * poll, so an fd which is kept around but not waited on doesn't keep
+ * host1x powered.
+ */
+struct nvhost_fence {
+	struct nvhost_master *host;
+	wait_queue_head_t wq;
+	struct mutex lock;	/* protects armed and the waiter refs */
+	bool armed;
+	atomic_t pending;
+	struct delayed_work idle_work;
+	u32 num_pts;
+	struct nvhost_fence_pt pts[0];
+};
+
+void nvhost_fence_signal(struct nvhost_fence *fence)
+{
+	if (atomic_dec_and_test(&fence->pending))
+		nvhost_module_idle(fence->host->dev);
+	wake_up_interruptible(&fence->wq);
+}
+
+static void nvhost_fence_disarm(struct nvhost_fence *fence)
+{
+	struct nvhost_master *host = fence->host;
+	u32 i;
+
+	nvhost_module_busy(host->dev);
+	for (i = 0; i < fence->num_pts; i++) {
+		if (!fence->pts[i].ref)
+			continue;
+		nvhost_intr_put_ref(&host->intr, fence->pts[i].id,
+				fence->pts[i].ref);
+		fence->pts[i].ref = NULL;
+	}
+
+	/* no handler can run now, so drop the reference they would have */
+	if (atomic_read(&fence->pending))
+		nvhost_module_idle(host->dev);
+	nvhost_module_idle(host->dev);
+	fence->armed = false;
+}
+
+static int nvhost_fence_arm(struct nvhost_fence *fence)
+{
+	struct nvhost_master *host = fence->host;
+	struct nvhost_syncpt *sp = &host->syncpt;
+	int err = 0;
+	u32 i;
+
+	atomic_set(&fence->pending, 1);
+	nvhost_module_busy(host->dev);
+
+	for (i = 0; i < fence->num_pts; i++) {
+		struct nvhost_fence_pt *pt = &fence->pts[i];
+		void *waiter;
+
+		nvhost_syncpt_update_min(sp, pt->id);
+		if (nvhost_syncpt_is_expired(sp, pt->id, pt->thresh))
+			continue;
+
+		waiter = nvhost_intr_alloc_waiter();
+		if (!waiter) {
+			err = -ENOMEM;
+			break;
+		}
+
+		atomic_inc(&fence->pending);
+		err = nvhost_intr_add_action(&host->intr, pt->id, pt->thresh,
+				NVHOST_INTR_ACTION_SIGNAL_FENCE, fence,
+				waiter, &pt->ref);
+		if (err) {
+			atomic_dec(&fence->pending);
+			break;
+		}
+	}
+
+	if (err) {
+		/* leaves the bias and the busy reference for disarm to drop */
+		nvhost_fence_disarm(fence);
+		return err;
+	}
+
+	fence->armed = true;
+	if (atomic_dec_and_test(&fence->pending))
+		nvhost_module_idle(host->dev);
+	return 0;
+}
+
+static void nvhost_fence_idle_work(struct work_struct *work)
+{
+	struct nvhost_fence *fence = container_of(to_delayed_work(work),
+					struct nvhost_fence, idle_work);
+
+	mutex_lock(&fence->lock);
+	/* a signalled fence holds no busy reference and stays armed */
+	if (fence->armed && atomic_read(&fence->pending)) {
+		if (waitqueue_active(&fence->wq))
+			schedule_delayed_work(&fence->idle_work,
+					NVHOST_FENCE_IDLE_CHECK);
+		else
+			nvhost_fence_disarm(fence);
+	}
+	mutex_unlock(&fence->lock);
+}
+
+static int nvhost_fence_release(struct inode *inode, struct file *filp)
+{
+	struct nvhost_fence *fence = filp->private_data;
+
+	cancel_delayed_work_sync(&fence->idle_work);
+	if (fence->armed)
+		nvhost_fence_disarm(fence);
+	kfree(fence);
+	return 0;
+}
+
+static unsigned int nvhost_fence_poll(struct file *filp, poll_table *wait)
+{
+	struct nvhost_fence *fence = filp->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(filp, &fence->wq, wait);
+
+	mutex_lock(&fence->lock);
+	if (!fence->armed) {
+		if (nvhost_fence_arm(fence))
+			mask = POLLERR;
+		else if (atomic_read(&fence->pending))
+			schedule_delayed_work(&fence->idle_work,
+					NVHOST_FENCE_IDLE_CHECK);
+	}
+	if (fence->armed && !atomic_read(&fence->pending))
+		mask = POLLIN | POLLRDNORM;
+	mutex_unlock(&fence->lock);
+
+	return mask;
+}
+
+static const struct file_operations nvhost_fence_ops = {
+	.owner = THIS_MODULE,
+	.release = nvhost_fence_release,
+	.poll = nvhost_fence_poll,
+};
+
+/* keep only the latest threshold per sync point */
+static void nvhost_fence_add_pt(struct nvhost_fence *fence, u32 id, u32 thresh)
+{
+	u32 i;
+
+	for (i = 0; i < fence->num_pts; i++) {
+		if (fence->pts[i].id != id)
+			continue;
+		if ((s32)(thresh - fence->pts[i].thresh) > 0)
+			fence->pts[i].thresh = thresh;
+		return;
+	}
+
+	fence->pts[fence->num_pts].id = id;
+	fence->pts[fence->num_pts].thresh = thresh;
+	fence->pts[fence->num_pts].ref = NULL;
+	fence->num_pts++;
+}
+
+static struct nvhost_fence *nvhost_fence_alloc(struct nvhost_master *host,
+		u32 max_pts)
+{
+	struct nvhost_fence *fence;
+
+	fence = kzalloc(sizeof(*fence) +
+			max_pts * sizeof(struct nvhost_fence_pt), GFP_KERNEL);
+	if (!fence)
+		return NULL;
+
+	fence->host = host;
+	init_waitqueue_head(&fence->wq);
+	mutex_init(&fence->lock);
+	INIT_DELAYED_WORK(&fence->idle_work, nvhost_fence_idle_work);
+	return fence;
+}
+
+static int nvhost_fence_install(struct nvhost_fence *fence)
+{
+	int fd;
+
+	fd = anon_inode_getfd("nvhost_fence", &nvhost_fence_ops, fence,
+			O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		kfree(fence);
+	return fd;
+}
+
+int nvhost_fence_create_fd(struct nvhost_master *host,
+			struct nvhost_ctrl_sync_fence_info __user *pts,
+			u32 num_pts)
+{
+	u32 nb_pts = nvhost_syncpt_nb_pts(&host->syncpt);
+	struct nvhost_ctrl_sync_fence_info pt;
+	struct nvhost_fence *fence;
+	u32 i;
+
+	if (num_pts == 0 || num_pts > nb_pts)
+		return -EINVAL;
+
+	fence = nvhost_fence_alloc(host, num_pts);
+	if (!fence)
+		return -ENOMEM;
+
+	for (i = 0; i < num_pts; i++) {
+		if (copy_from_user(&pt, pts + i, sizeof(pt))) {
+			kfree(fence);
+			return -EFAULT;
+		}
+		if (pt.id >= nb_pts) {
+			kfree(fence);
+			return -EINVAL;
+		}
+		nvhost_fence_add_pt(fence, pt.id, pt.thresh);
+	}
+
+	return nvhost_fence_install(fence);
+}
+
+static struct nvhost_fence *nvhost_fence_fget(int fd, struct file **filp)
+{
+	struct file *file = fget(fd);
+
+	if (!file)
+		return NULL;
+	if (file->f_op != &nvhost_fence_ops) {
+		fput(file);
+		return NULL;
+	}
+
+	*filp = file;
+	return file->private_data;
+}
+
+int nvhost_fence_merge_fd(struct nvhost_master *host, int fd1, int fd2)
+{
+	struct nvhost_fence *a, *b, *fence;
+	struct file *fa, *fb;
+	int err = -EINVAL;
+	u32 i;
+
+	a = nvhost_fence_fget(fd1, &fa);
+	if (!a)
+		return -EINVAL;
+	b = nvhost_fence_fget(fd2, &fb);
+	if (!b)
+		goto put_a;
+	if (a->host != host || b->host != host)
+		goto put_b;
+
+	/* duplicates are folded, so the result never exceeds nb_pts */
+	fence = nvhost_fence_alloc(host, a->num_pts + b->num_pts);
+	if (!fence) {
+		err = -ENOMEM;
+		goto put_b;
+	}
+
+	for (i = 0; i < a->num_pts; i++)
+		nvhost_fence_add_pt(fence, a->pts[i].id, a->pts[i].thresh);
+	for (i = 0; i < b->num_pts; i++)
+		nvhost_fence_add_pt(fence, b->pts[i].id, b->pts[i].thresh);
+
+	err = nvhost_fence_install(fence);
+
+put_b:
+	fput(fb);
+put_a:
+	fput(fa);
+	return err;
+}
@@ -0,0 +1,53 @@
+/*
+ * drivers/video/tegra/host/nvhost_fence.h
+ *
+ * Tegra Graphics Host Sync Point Fences
+ *
+ * Copyright (c) 2012, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NVHOST_FENCE_H
+#define __NVHOST_FENCE_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+struct nvhost_master;
+struct nvhost_fence;
+struct nvhost_ctrl_sync_fence_info;
+
+/**
+ * Create a fence file descriptor that becomes readable once every
+ * (id, thresh) pair in @pts has expired. Duplicate ids are folded into
+ * the later threshold. The interrupts are only armed while the fd is
+ * polled. Returns the new fd or a negative error.
+ */
+int nvhost_fence_create_fd(struct nvhost_master *host,
+			struct nvhost_ctrl_sync_fence_info __user *pts,
+			u32 num_pts);
+
+/**
+ * Create a fence file descriptor that signals once both @fd1 and @fd2
+ * have signalled. Returns the new fd or a negative error.
+ */
+int nvhost_fence_merge_fd(struct nvhost_master *host, int fd1, int fd2);
+
+/**
+ * Called by the interrupt code when one of the fence's sync points
+ * has reached its threshold.
+ */
+void nvhost_fence_signal(struct nvhost_fence *fence);
+
+#endif
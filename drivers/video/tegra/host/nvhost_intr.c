@@ -24,9 +24,12 @@
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
 #include <trace/events/nvhost.h>
 #include "nvhost_channel.h"
 #include "nvhost_hwctx.h"
+#include "nvhost_fence.h"
 #include "chip_support.h"
 
 /*** Wait list management ***/
@@ -75,28 +78,32 @@ static bool add_waiter_to_queue(struct nvhost_waitlist *waiter,
 
 /**
  * run through a waiter queue for a single sync point ID
- * and gather all completed waiters into lists by actions
+ * and gather all completed waiters into lists by actions.
+ * returns the number of completed waiters
  */
-static void remove_completed_waiters(struct list_head *head, u32 sync,
+static int remove_completed_waiters(struct list_head *head, u32 sync,
 			struct list_head completed[NVHOST_INTR_ACTION_COUNT])
 {
 	struct list_head *dest;
 	struct nvhost_waitlist *waiter, *next, *prev;
+	int nr = 0;
 
 	list_for_each_entry_safe(waiter, next, head, list) {
 		if ((s32)(waiter->thresh - sync) > 0)
 			break;
 
 		dest = completed + waiter->action;
-
-		/* consolidate submit cleanups */
-		if (waiter->action == NVHOST_INTR_ACTION_SUBMIT_COMPLETE
-			&& !list_empty(dest)) {
-			prev = list_entry(dest->prev,
-					struct nvhost_waitlist, list);
-			if (prev->data == waiter->data) {
-				prev->count++;
-				dest = NULL;
+		nr++;
+
+		/* consolidate submit cleanups per channel, even across
+		 * sync points drained in the same pass */
+		if (waiter->action == NVHOST_INTR_ACTION_SUBMIT_COMPLETE) {
+			list_for_each_entry(prev, dest, list) {
+				if (prev->data == waiter->data) {
+					prev->count++;
+					dest = NULL;
+					break;
+				}
 			}
 		}
 
@@ -108,6 +115,8 @@ static void remove_completed_waiters(struct list_head *head, u32 sync,
 			list_move_tail(&waiter->list, dest);
 		}
 	}
+
+	return nr;
 }
 
 void reset_threshold_interrupt(struct nvhost_intr *intr,
@@ -164,6 +173,13 @@ static void action_wakeup_interruptible(struct nvhost_waitlist *waiter)
 	wake_up_interruptible(wq);
 }
 
+static void action_signal_fence(struct nvhost_waitlist *waiter)
+{
+	struct nvhost_fence *fence = waiter->data;
+
+	nvhost_fence_signal(fence);
+}
+
 typedef void (*action_handler)(struct nvhost_waitlist *waiter);
 
 static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
@@ -171,6 +187,7 @@ static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
 	action_ctxsave,
 	action_wakeup,
 	action_wakeup_interruptible,
+	action_signal_fence,
 };
 
 static void run_handlers(struct list_head completed[NVHOST_INTR_ACTION_COUNT])
@@ -192,25 +209,23 @@ static void run_handlers(struct list_head completed[NVHOST_INTR_ACTION_COUNT])
 }
 
 /**
- * Remove & handle all waiters that have completed for the given syncpt
+ * Remove all waiters that have completed for the given syncpt into
+ * completed, and re-arm or disable its threshold interrupt.
+ * returns the number of completed waiters
  */
-static int process_wait_list(struct nvhost_intr *intr,
+static int collect_wait_list(struct nvhost_intr *intr,
 			     struct nvhost_intr_syncpt *syncpt,
-			     u32 threshold)
+			     u32 threshold,
+			     struct list_head completed[NVHOST_INTR_ACTION_COUNT])
 {
-	struct list_head completed[NVHOST_INTR_ACTION_COUNT];
-	unsigned int i;
-	int empty;
-
-	for (i = 0; i < NVHOST_INTR_ACTION_COUNT; ++i)
-		INIT_LIST_HEAD(completed + i);
+	int nr;
 
 	spin_lock(&syncpt->lock);
 
-	remove_completed_waiters(&syncpt->wait_head, threshold, completed);
+	nr = remove_completed_waiters(&syncpt->wait_head, threshold,
+				completed);
 
-	empty = list_empty(&syncpt->wait_head);
-	if (empty)
+	if (list_empty(&syncpt->wait_head))
 		intr_op().disable_syncpt_intr(intr, syncpt->id);
 	else
 		reset_threshold_interrupt(intr, &syncpt->wait_head,
@@ -218,25 +233,94 @@ static int process_wait_list(struct nvhost_intr *intr,
 
 	spin_unlock(&syncpt->lock);
 
+	return nr;
+}
+
+/**
+ * Remove & handle all waiters that have completed for the given syncpt
+ */
+static void process_wait_list(struct nvhost_intr *intr,
+			     struct nvhost_intr_syncpt *syncpt,
+			     u32 threshold)
+{
+	struct list_head completed[NVHOST_INTR_ACTION_COUNT];
+	unsigned int i;
+
+	for (i = 0; i < NVHOST_INTR_ACTION_COUNT; ++i)
+		INIT_LIST_HEAD(completed + i);
+
+	collect_wait_list(intr, syncpt, threshold, completed);
+
 	run_handlers(completed);
+}
+
+static void update_stats(struct nvhost_intr *intr, int nr_waiters)
+{
+	struct nvhost_intr_stats *stats = &intr->stats;
+	u32 irqs;
+
+	stats->passes++;
+	stats->waiters += nr_waiters;
+
+	if (time_before(jiffies, stats->window_start + HZ))
+		return;
 
-	return empty;
+	irqs = atomic_read(&stats->irqs);
+	stats->irqs_per_sec = div_u64((u64)(irqs - stats->window_irqs) * HZ,
+			jiffies - stats->window_start);
+	stats->waiters_per_irq_x100 = irqs == stats->window_irqs ? 0 :
+		div_u64((stats->waiters - stats->window_waiters) * 100,
+			irqs - stats->window_irqs);
+
+	stats->window_start = jiffies;
+	stats->window_irqs = irqs;
+	stats->window_waiters = stats->waiters;
 }
 
 /*** host syncpt interrupt service functions ***/
 /**
  * Sync point threshold interrupt service thread function
- * Handles sync point threshold triggers, in thread context
+ * Handles all latched sync point threshold triggers, in thread context
  */
 irqreturn_t nvhost_syncpt_thresh_fn(int irq, void *dev_id)
 {
-	struct nvhost_intr_syncpt *syncpt = dev_id;
-	unsigned int id = syncpt->id;
-	struct nvhost_intr *intr = intr_syncpt_to_intr(syncpt);
-	struct nvhost_master *dev = intr_to_dev(intr);
+	struct nvhost_master *dev = dev_id;
+	struct nvhost_intr *intr = &dev->intr;
+	struct list_head completed[NVHOST_INTR_ACTION_COUNT];
+	u32 nb_pts = nvhost_syncpt_nb_pts(&dev->syncpt);
+	u32 delay = intr->moderation_delay_us;
+	unsigned int i;
+	int id, nr = 0;
+
+	/* completions arriving faster than the threshold: keep the expired
+	 * sync points masked a while longer and drain them all at once */
+	if (delay && ktime_us_delta(ktime_get(), intr->last_pass) <
+			intr->moderation_thresh_us) {
+		usleep_range(delay, delay + delay / 2);
+		intr->stats.moderated++;
+	}
+
+	for (i = 0; i < NVHOST_INTR_ACTION_COUNT; ++i)
+		INIT_LIST_HEAD(completed + i);
+
+	for (i = 0; i < BITS_TO_LONGS(nb_pts); i++) {
+		unsigned long pending = xchg(&intr->syncpt_pending[i], 0);
+
+		for_each_set_bit(id, &pending, BITS_PER_LONG) {
+			struct nvhost_intr_syncpt *syncpt =
+				intr->syncpt + (i * BITS_PER_LONG + id);
+
+			nr += collect_wait_list(intr, syncpt,
+				nvhost_syncpt_update_min(&dev->syncpt,
+					syncpt->id),
+				completed);
+		}
+	}
+
+	run_handlers(completed);
 
-	(void)process_wait_list(intr, syncpt,
-				nvhost_syncpt_update_min(&dev->syncpt, id));
+	update_stats(intr, nr);
+	intr->last_pass = ktime_get();
 
 	return IRQ_HANDLED;
 }
@@ -337,8 +421,8 @@ void nvhost_intr_put_ref(struct nvhost_intr *intr, u32 id, void *ref)
 		schedule();
 
 	syncpt = intr->syncpt + id;
-	(void)process_wait_list(intr, syncpt,
-				nvhost_syncpt_update_min(&host->syncpt, id));
+	process_wait_list(intr, syncpt,
+			nvhost_syncpt_update_min(&host->syncpt, id));
 
 	kref_put(&waiter->refcount, waiter_release);
 }
@@ -355,7 +439,10 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 
 	mutex_init(&intr->mutex);
 	intr->host_syncpt_irq_base = irq_sync;
-	intr->wq = create_workqueue("host_syncpt");
+	intr->moderation_thresh_us = 250;
+	intr->moderation_delay_us = 100;
+	intr->last_pass = ktime_set(0, 0);
+	intr->stats.window_start = jiffies;
 	intr_op().init_host_sync(intr);
 	intr->host_general_irq = irq_gen;
 	intr->host_general_irq_requested = false;
@@ -381,7 +468,6 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 void nvhost_intr_deinit(struct nvhost_intr *intr)
 {
 	nvhost_intr_stop(intr);
-	destroy_workqueue(intr->wq);
 }
 
 void nvhost_intr_start(struct nvhost_intr *intr, u32 hz)
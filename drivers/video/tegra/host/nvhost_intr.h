@@ -25,6 +25,7 @@
 #include <linux/semaphore.h>
 #include <linux/interrupt.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
 
 struct nvhost_channel;
 
@@ -53,6 +54,12 @@ enum nvhost_intr_action {
 	 */
 	NVHOST_INTR_ACTION_WAKEUP_INTERRUPTIBLE,
 
+	/**
+	 * Signal one sync point of a fence.
+	 * 'data' points to a struct nvhost_fence
+	 */
+	NVHOST_INTR_ACTION_SIGNAL_FENCE,
+
 	NVHOST_INTR_ACTION_COUNT
 };
 
@@ -66,16 +73,40 @@ struct nvhost_intr_syncpt {
 	spinlock_t lock;
 	struct list_head wait_head;
 	char thresh_irq_name[12];
-	struct work_struct work;
+};
+
+struct nvhost_intr_stats {
+	atomic_t irqs;		/* hard interrupts that found expired syncpts */
+	u32 passes;		/* threaded handler passes */
+	u64 waiters;		/* waiters completed by those passes */
+	u32 moderated;		/* passes delayed by interrupt moderation */
+
+	/* rates over the last full second, updated by the handler thread */
+	unsigned long window_start;
+	u32 window_irqs;
+	u64 window_waiters;
+	u32 irqs_per_sec;
+	u32 waiters_per_irq_x100;
 };
 
 struct nvhost_intr {
 	struct nvhost_intr_syncpt *syncpt;
+	unsigned long *syncpt_pending;	/* ids latched by the hard irq */
 	struct mutex mutex;
 	int host_general_irq;
 	int host_syncpt_irq_base;
 	bool host_general_irq_requested;
-	struct workqueue_struct *wq;
+
+	/*
+	 * If a threaded pass starts less than moderation_thresh_us after
+	 * the previous one ended, sleep moderation_delay_us before draining
+	 * so that the expired sync points stay disabled and completions
+	 * pile up into one pass. A delay of 0 disables moderation.
+	 */
+	u32 moderation_thresh_us;
+	u32 moderation_delay_us;
+	ktime_t last_pass;
+	struct nvhost_intr_stats stats;
 };
 #define intr_to_dev(x) container_of(x, struct nvhost_master, intr)
 #define intr_syncpt_to_intr(is) (is->intr)
@@ -114,5 +145,10 @@ void nvhost_intr_deinit(struct nvhost_intr *intr);
 void nvhost_intr_start(struct nvhost_intr *intr, u32 hz);
 void nvhost_intr_stop(struct nvhost_intr *intr);
 
+/**
+ * Threaded handler for the sync point cascade interrupt. Drains every
+ * sync point latched in syncpt_pending in a single pass and runs the
+ * completed actions together. dev_id is the struct nvhost_master.
+ */
 irqreturn_t nvhost_syncpt_thresh_fn(int irq, void *dev_id);
 #endif
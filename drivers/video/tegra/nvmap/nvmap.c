@@ -85,6 +85,8 @@ static int pin_locked(struct nvmap_client *client, struct nvmap_handle *h)
 			h->pgalloc.area = area;
 		}
 	}
+	if (!h->heap_pgalloc)
+		nvmap_heap_compact_cancel(h);
 	trace_handle_pin(client, h, atomic_read(&h->pin));
 	return 0;
 }
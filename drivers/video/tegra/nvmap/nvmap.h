@@ -26,6 +26,7 @@
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/rbtree.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
@@ -105,7 +106,11 @@ struct nvmap_handle {
 	bool secure;		/* zap IOVMM area on unpin */
 	bool heap_pgalloc;	/* handle is page allocated (sysmem / iovmm) */
 	bool alloc;		/* handle has memory allocated */
+	bool allocating;	/* an allocation is in progress, under lock */
 	unsigned int userflags;	/* flags passed from userspace */
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	atomic_t compact_cancel; /* abandon the background move in flight */
+#endif
 	struct mutex lock;
 };
 
@@ -116,6 +121,16 @@ struct nvmap_handle {
 #define NVMAP_WB_POOL NVMAP_HANDLE_CACHEABLE
 #define NVMAP_NUM_POOLS (NVMAP_HANDLE_CACHEABLE + 1)
 
+#define NVMAP_MAGAZINE_SIZE 16
+#define NVMAP_POOL_ZEROED_PAGES 256
+
+/* per-CPU cache of pool pages, so small allocations skip the pool lock */
+struct nvmap_page_magazine {
+	spinlock_t lock;
+	int npages;
+	struct page *pages[NVMAP_MAGAZINE_SIZE];
+};
+
 struct nvmap_page_pool {
 	struct mutex lock;
 	int npages;
@@ -123,6 +138,10 @@ struct nvmap_page_pool {
 	struct page **shrink_array;
 	int max_pages;
 	int flags;
+	int nzeroed;			/* pages zeroed by the refill thread */
+	struct page **zeroed_array;
+	struct nvmap_page_magazine __percpu *magazines;
+	atomic_t magazine_pages;
 };
 
 int nvmap_page_pool_init(struct nvmap_page_pool *pool, int flags);
@@ -166,6 +185,9 @@ struct nvmap_client {
 	bool				super;
 	atomic_t			count;
 	struct task_struct		*task;
+	atomic64_t			cache_maint_bytes;
+	atomic64_t			cache_maint_ns;
+	atomic_t			cache_maint_full;
 	struct list_head		list;
 	struct nvmap_carveout_commit	carveout_commit[0];
 };
@@ -186,6 +208,14 @@ static inline void nvmap_ref_unlock(struct nvmap_client *priv)
 	mutex_unlock(&priv->ref_lock);
 }
 
+/* charge the client's process for memory it holds handles to */
+static inline void nvmap_client_charge(struct nvmap_client *client,
+				       long bytes)
+{
+	if (client->task)
+		task_drvmem_add(client->task, DRVMEM_NVMAP, bytes);
+}
+
 static inline struct nvmap_handle *nvmap_handle_get(struct nvmap_handle *h)
 {
 	if (unlikely(atomic_inc_return(&h->ref) <= 1)) {
@@ -208,17 +238,22 @@ static inline void nvmap_handle_put(struct nvmap_handle *h)
 		_nvmap_handle_free(h);
 }
 
-static inline pgprot_t nvmap_pgprot(struct nvmap_handle *h, pgprot_t prot)
+static inline pgprot_t nvmap_flags_pgprot(unsigned int flags, pgprot_t prot)
 {
-	if (h->flags == NVMAP_HANDLE_UNCACHEABLE)
+	if (flags == NVMAP_HANDLE_UNCACHEABLE)
 		return pgprot_noncached(prot);
-	else if (h->flags == NVMAP_HANDLE_WRITE_COMBINE)
+	else if (flags == NVMAP_HANDLE_WRITE_COMBINE)
 		return pgprot_writecombine(prot);
-	else if (h->flags == NVMAP_HANDLE_INNER_CACHEABLE)
+	else if (flags == NVMAP_HANDLE_INNER_CACHEABLE)
 		return pgprot_inner_writeback(prot);
 	return prot;
 }
 
+static inline pgprot_t nvmap_pgprot(struct nvmap_handle *h, pgprot_t prot)
+{
+	return nvmap_flags_pgprot(h->flags, prot);
+}
+
 #else /* CONFIG_TEGRA_NVMAP */
 struct nvmap_handle *nvmap_handle_get(struct nvmap_handle *h);
 void nvmap_handle_put(struct nvmap_handle *h);
@@ -266,6 +301,8 @@ struct nvmap_deferred_ops *nvmap_get_deferred_ops_from_dev(
 int nvmap_find_cache_maint_op(struct nvmap_device *dev,
 		struct nvmap_handle *h);
 
+void nvmap_cache_maint_calibrate(struct device *dev);
+
 struct nvmap_handle *nvmap_validate_get(struct nvmap_client *client,
 					unsigned long handle);
 
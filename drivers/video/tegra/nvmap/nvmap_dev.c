@@ -25,6 +25,7 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/kernel.h>
+#include <linux/math64.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/oom.h>
@@ -661,6 +662,9 @@ struct nvmap_client *nvmap_create_client(struct nvmap_device *dev,
 	client->handle_refs = RB_ROOT;
 
 	atomic_set(&client->iovm_commit, 0);
+	atomic64_set(&client->cache_maint_bytes, 0);
+	atomic64_set(&client->cache_maint_ns, 0);
+	atomic_set(&client->cache_maint_full, 0);
 
 	client->iovm_limit = nvmap_mru_vm_size(client->share->iovmm);
 
@@ -708,6 +712,9 @@ static void destroy_client(struct nvmap_client *client)
 		ref = rb_entry(n, struct nvmap_handle_ref, node);
 		rb_erase(&ref->node, &client->handle_refs);
 
+		if (ref->handle->alloc)
+			nvmap_client_charge(client, -(long)ref->handle->size);
+
 		smp_rmb();
 		pins = atomic_read(&ref->pin);
 
@@ -903,6 +910,10 @@ static long nvmap_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		err = nvmap_ioctl_cache_maint(filp, uarg);
 		break;
 
+	case NVMAP_IOC_CACHE_LIST:
+		err = nvmap_ioctl_cache_maint_list(filp, uarg);
+		break;
+
 	case NVMAP_IOC_SHARE:
 		err = nvmap_ioctl_share_dmabuf(filp, uarg);
 		break;
@@ -1143,6 +1154,43 @@ static const struct file_operations debug_iovmm_clients_fops = {
 	.release = single_release,
 };
 
+static int nvmap_debug_cache_maint_show(struct seq_file *s, void *unused)
+{
+	unsigned long flags;
+	struct nvmap_client *client;
+	struct nvmap_device *dev = s->private;
+
+	spin_lock_irqsave(&dev->clients_lock, flags);
+	seq_printf(s, "%-18s %18s %8s %12s %8s %12s\n", "CLIENT", "PROCESS",
+		"PID", "BYTES", "FULL", "USECS");
+	list_for_each_entry(client, &dev->clients, list) {
+		client_stringify(client, s);
+		seq_printf(s, " %12llu %8u %12llu\n",
+			   (unsigned long long)
+				atomic64_read(&client->cache_maint_bytes),
+			   atomic_read(&client->cache_maint_full),
+			   (unsigned long long)div_u64(
+				atomic64_read(&client->cache_maint_ns),
+				NSEC_PER_USEC));
+	}
+	spin_unlock_irqrestore(&dev->clients_lock, flags);
+
+	return 0;
+}
+
+static int nvmap_debug_cache_maint_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvmap_debug_cache_maint_show,
+			   inode->i_private);
+}
+
+static const struct file_operations debug_cache_maint_fops = {
+	.open = nvmap_debug_cache_maint_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int nvmap_debug_iovmm_allocations_show(struct seq_file *s, void *unused)
 {
 	unsigned long flags;
@@ -1403,9 +1451,17 @@ static int nvmap_probe(struct platform_device *pdev)
 				debugfs_create_u32(name, S_IRUGO|S_IWUSR,
 					iovmm_root,
 					&dev->iovmm_master.pools[i].npages);
+				sprintf(name, "%s_page_pool_zeroed_pages",
+					memtype_string[i]);
+				debugfs_create_u32(name, S_IRUGO,
+					iovmm_root,
+					&dev->iovmm_master.pools[i].nzeroed);
 			}
 #endif
 		}
+		debugfs_create_file("cache_maint_clients", 0444,
+				    nvmap_debug_root, dev,
+				    &debug_cache_maint_fops);
 #ifdef CONFIG_NVMAP_CACHE_MAINT_BY_SET_WAYS
 		debugfs_create_size_t("cache_maint_inner_threshold", 0600,
 				      nvmap_debug_root,
@@ -1418,6 +1474,8 @@ static int nvmap_probe(struct platform_device *pdev)
 #endif
 	}
 
+	nvmap_cache_maint_calibrate(&pdev->dev);
+
 	platform_set_drvdata(pdev, dev);
 	nvmap_dev = dev;
 
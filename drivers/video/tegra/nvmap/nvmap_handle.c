@@ -22,8 +22,10 @@
 
 #define pr_fmt(fmt)	"%s: " fmt, __func__
 
+#include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/kernel.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/rbtree.h>
@@ -63,9 +65,15 @@
 #ifdef CONFIG_NVMAP_PAGE_POOLS
 
 #define NVMAP_TEST_PAGE_POOL_SHRINKER 1
+#define NVMAP_TEST_PAGE_POOL_BENCH 1
 static bool enable_pp = 1;
 static int pool_size[NVMAP_NUM_POOLS];
 
+static struct nvmap_page_pool *refill_pools[NVMAP_NUM_POOLS];
+static struct task_struct *refill_task;
+static DECLARE_WAIT_QUEUE_HEAD(refill_wait);
+static bool refill_pending;
+
 static char *s_memtype_str[] = {
 	"uc",
 	"wc",
@@ -73,6 +81,14 @@ static char *s_memtype_str[] = {
 	"wb",
 };
 
+typedef int (*set_pages_array) (struct page **pages, int addrinarray);
+static const set_pages_array s_cpa[] = {
+	set_pages_array_uc,
+	set_pages_array_wc,
+	set_pages_array_iwb,
+	set_pages_array_wb
+};
+
 static inline void nvmap_page_pool_lock(struct nvmap_page_pool *pool)
 {
 	mutex_lock(&pool->lock);
@@ -83,62 +99,234 @@ static inline void nvmap_page_pool_unlock(struct nvmap_page_pool *pool)
 	mutex_unlock(&pool->lock);
 }
 
-static struct page *nvmap_page_pool_alloc_locked(struct nvmap_page_pool *pool)
+static struct page *nvmap_page_pool_pop(struct page **array, int *count)
 {
-	struct page *page = NULL;
+	struct page *page;
 
-	if (pool->npages > 0) {
-		page = pool->page_array[--pool->npages];
-		pool->page_array[pool->npages] = NULL;
-		atomic_dec(&page->_count);
-		BUG_ON(atomic_read(&page->_count) != 1);
-	}
+	if (*count <= 0)
+		return NULL;
+
+	page = array[--*count];
+	array[*count] = NULL;
+	atomic_dec(&page->_count);
+	BUG_ON(atomic_read(&page->_count) != 1);
 	return page;
 }
 
-static struct page *nvmap_page_pool_alloc(struct nvmap_page_pool *pool)
+static void nvmap_page_pool_push(struct page **array, int *count,
+				 struct page *page)
 {
-	struct page *page = NULL;
+	atomic_inc(&page->_count);
+	BUG_ON(atomic_read(&page->_count) != 2);
+	BUG_ON(array[*count] != NULL);
+	array[(*count)++] = page;
+}
 
-	if (pool) {
-		nvmap_page_pool_lock(pool);
-		page = nvmap_page_pool_alloc_locked(pool);
-		nvmap_page_pool_unlock(pool);
-	}
+static struct page *nvmap_page_pool_alloc_locked(struct nvmap_page_pool *pool)
+{
+	struct page *page;
+
+	page = nvmap_page_pool_pop(pool->page_array, &pool->npages);
+	if (!page)
+		page = nvmap_page_pool_pop(pool->zeroed_array, &pool->nzeroed);
 	return page;
 }
 
+/* pages held by the pool, including those parked in per-CPU magazines */
+static int nvmap_page_pool_get_available_count(struct nvmap_page_pool *pool)
+{
+	return pool->npages + pool->nzeroed +
+		atomic_read(&pool->magazine_pages);
+}
+
 static bool nvmap_page_pool_release_locked(struct nvmap_page_pool *pool,
 					    struct page *page)
 {
 	int ret = false;
 
-	if (enable_pp && pool->npages < pool->max_pages) {
-		atomic_inc(&page->_count);
-		BUG_ON(atomic_read(&page->_count) != 2);
-		BUG_ON(pool->page_array[pool->npages] != NULL);
-		pool->page_array[pool->npages++] = page;
+	if (enable_pp &&
+	    nvmap_page_pool_get_available_count(pool) < pool->max_pages) {
+		nvmap_page_pool_push(pool->page_array, &pool->npages, page);
 		ret = true;
 	}
 	return ret;
 }
 
-static bool nvmap_page_pool_release(struct nvmap_page_pool *pool,
-					  struct page *page)
+static int nvmap_page_magazine_get(struct nvmap_page_pool *pool,
+				   struct page **pages, int nr)
 {
-	int ret = false;
+	struct nvmap_page_magazine *mag;
+	int got = 0;
+
+	if (!pool->magazines || !atomic_read(&pool->magazine_pages))
+		return 0;
+
+	mag = get_cpu_ptr(pool->magazines);
+	spin_lock(&mag->lock);
+	while (got < nr && mag->npages) {
+		pages[got] = nvmap_page_pool_pop(mag->pages, &mag->npages);
+		got++;
+	}
+	spin_unlock(&mag->lock);
+	put_cpu_ptr(pool->magazines);
+
+	atomic_sub(got, &pool->magazine_pages);
+	return got;
+}
+
+static int nvmap_page_magazine_put(struct nvmap_page_pool *pool,
+				   struct page **pages, int nr)
+{
+	struct nvmap_page_magazine *mag;
+	int done = 0;
+	int room;
+
+	if (!pool->magazines)
+		return 0;
+
+	/*
+	 * Magazine pages count against max_pages like any other pool page.
+	 * The unlocked read can overshoot by at most one magazine per CPU.
+	 */
+	room = pool->max_pages - nvmap_page_pool_get_available_count(pool);
+	if (room <= 0)
+		return 0;
+	nr = min(nr, room);
+
+	mag = get_cpu_ptr(pool->magazines);
+	spin_lock(&mag->lock);
+	while (done < nr && mag->npages < NVMAP_MAGAZINE_SIZE) {
+		nvmap_page_pool_push(mag->pages, &mag->npages, pages[done]);
+		done++;
+	}
+	spin_unlock(&mag->lock);
+	put_cpu_ptr(pool->magazines);
+
+	atomic_add(done, &pool->magazine_pages);
+	return done;
+}
+
+static int nvmap_page_pool_zeroed_target(struct nvmap_page_pool *pool)
+{
+	return min(NVMAP_POOL_ZEROED_PAGES, pool->max_pages);
+}
+
+static void nvmap_page_pool_wake_refill(struct nvmap_page_pool *pool)
+{
+	if (refill_task && !refill_pending &&
+	    pool->nzeroed < nvmap_page_pool_zeroed_target(pool) / 2) {
+		refill_pending = true;
+		wake_up(&refill_wait);
+	}
+}
 
-	if (pool) {
+/*
+ * Takes up to nr pages out of the pool and returns how many were found.
+ * With zeroed set, the pre-zeroed pages are handed out first and their
+ * number is returned in *nr_zeroed. Otherwise pages come from this CPU's
+ * magazine, then from the shared pool under a single lock acquisition.
+ */
+static int nvmap_page_pool_alloc_pages(struct nvmap_page_pool *pool,
+				       struct page **pages, int nr,
+				       bool zeroed, int *nr_zeroed)
+{
+	int got = 0;
+
+	*nr_zeroed = 0;
+	if (!pool)
+		return 0;
+
+	if (zeroed && pool->nzeroed) {
 		nvmap_page_pool_lock(pool);
-		ret = nvmap_page_pool_release_locked(pool, page);
+		while (got < nr && pool->nzeroed) {
+			pages[got] = nvmap_page_pool_pop(pool->zeroed_array,
+							 &pool->nzeroed);
+			got++;
+		}
 		nvmap_page_pool_unlock(pool);
+		*nr_zeroed = got;
 	}
-	return ret;
+
+	got += nvmap_page_magazine_get(pool, pages + got, nr - got);
+
+	if (got < nr) {
+		nvmap_page_pool_lock(pool);
+		while (got < nr) {
+			pages[got] = nvmap_page_pool_alloc_locked(pool);
+			if (!pages[got])
+				break;
+			got++;
+		}
+		nvmap_page_pool_unlock(pool);
+	}
+
+	nvmap_page_pool_wake_refill(pool);
+	return got;
 }
 
-static int nvmap_page_pool_get_available_count(struct nvmap_page_pool *pool)
+/*
+ * Returns a leading run of pages[] to the pool and reports how many were
+ * taken; the caller frees the rest.
+ */
+static int nvmap_page_pool_release_pages(struct nvmap_page_pool *pool,
+					 struct page **pages, int nr)
 {
-	return pool->npages;
+	int done;
+
+	if (!pool || !enable_pp || !pool->max_pages)
+		return 0;
+
+	done = nvmap_page_magazine_put(pool, pages, nr);
+	if (done < nr) {
+		nvmap_page_pool_lock(pool);
+		while (done < nr &&
+		       nvmap_page_pool_release_locked(pool, pages[done]))
+			done++;
+		nvmap_page_pool_unlock(pool);
+	}
+	return done;
+}
+
+static int nvmap_page_pool_free_magazines(struct nvmap_page_pool *pool,
+					  int nr_free)
+{
+	struct page *pages[NVMAP_MAGAZINE_SIZE];
+	int cpu;
+	int err;
+	int n;
+
+	if (!pool->magazines)
+		return nr_free;
+
+	for_each_possible_cpu(cpu) {
+		struct nvmap_page_magazine *mag;
+
+		if (!nr_free)
+			break;
+
+		mag = per_cpu_ptr(pool->magazines, cpu);
+		n = 0;
+		spin_lock(&mag->lock);
+		while (n < nr_free && mag->npages) {
+			pages[n] = nvmap_page_pool_pop(mag->pages,
+						       &mag->npages);
+			n++;
+		}
+		spin_unlock(&mag->lock);
+
+		if (!n)
+			continue;
+
+		atomic_sub(n, &pool->magazine_pages);
+		nr_free -= n;
+
+		/* This op should never fail. */
+		err = set_pages_array_wb(pages, n);
+		BUG_ON(err);
+		while (n--)
+			__free_page(pages[n]);
+	}
+	return nr_free;
 }
 
 static int nvmap_page_pool_free(struct nvmap_page_pool *pool, int nr_free)
@@ -168,7 +356,124 @@ static int nvmap_page_pool_free(struct nvmap_page_pool *pool, int nr_free)
 	while (idx--)
 		__free_page(pool->shrink_array[idx]);
 	nvmap_page_pool_unlock(pool);
-	return i;
+	return nvmap_page_pool_free_magazines(pool, i);
+}
+
+/* zeroes a pool page and makes the zeroes visible to devices */
+static int nvmap_page_pool_zero_page(struct nvmap_page_pool *pool,
+				     struct page *page)
+{
+	phys_addr_t paddr = page_to_phys(page);
+	pte_t **pte = NULL;
+	void *vaddr;
+
+	if (!PageHighMem(page)) {
+		vaddr = page_address(page);
+	} else {
+		pgprot_t prot = nvmap_flags_pgprot(pool->flags, pgprot_kernel);
+		unsigned long kaddr;
+
+		pte = nvmap_alloc_pte(nvmap_dev, (void **)&kaddr);
+		if (IS_ERR(pte))
+			return PTR_ERR(pte);
+		set_pte_at(&init_mm, kaddr, *pte,
+			   pfn_pte(__phys_to_pfn(paddr), prot));
+		flush_tlb_kernel_page(kaddr);
+		vaddr = (void *)kaddr;
+	}
+
+	memset(vaddr, 0, PAGE_SIZE);
+
+	if (pool->flags == NVMAP_HANDLE_INNER_CACHEABLE ||
+	    pool->flags == NVMAP_HANDLE_CACHEABLE)
+		dmac_map_area(vaddr, PAGE_SIZE, DMA_TO_DEVICE);
+	if (pool->flags == NVMAP_HANDLE_CACHEABLE)
+		outer_clean_range(paddr, paddr + PAGE_SIZE);
+	wmb();
+
+	if (pte)
+		nvmap_free_pte(nvmap_dev, pte);
+	return 0;
+}
+
+/*
+ * Tops up the pool's zeroed reserve, preferably by recycling pages that
+ * were released to the pool, otherwise with fresh pages while the pool is
+ * below its size.
+ */
+static void nvmap_page_pool_refill(struct nvmap_page_pool *pool)
+{
+	struct page *page;
+	int err;
+
+	while (!kthread_should_stop()) {
+		nvmap_page_pool_lock(pool);
+		if (!enable_pp ||
+		    pool->nzeroed >= nvmap_page_pool_zeroed_target(pool)) {
+			nvmap_page_pool_unlock(pool);
+			break;
+		}
+		page = nvmap_page_pool_pop(pool->page_array, &pool->npages);
+		if (!page &&
+		    nvmap_page_pool_get_available_count(pool) >=
+		    pool->max_pages) {
+			nvmap_page_pool_unlock(pool);
+			break;
+		}
+		nvmap_page_pool_unlock(pool);
+
+		if (!page) {
+			page = alloc_page(GFP_NVMAP);
+			if (!page)
+				break;
+			if ((*s_cpa[pool->flags])(&page, 1)) {
+				__free_page(page);
+				break;
+			}
+		}
+
+		err = nvmap_page_pool_zero_page(pool, page);
+
+		nvmap_page_pool_lock(pool);
+		if (!err &&
+		    pool->nzeroed < nvmap_page_pool_zeroed_target(pool) &&
+		    nvmap_page_pool_get_available_count(pool) <
+		    pool->max_pages) {
+			nvmap_page_pool_push(pool->zeroed_array,
+					     &pool->nzeroed, page);
+			page = NULL;
+		}
+		nvmap_page_pool_unlock(pool);
+
+		if (page) {
+			/* This op should never fail. */
+			err = set_pages_array_wb(&page, 1);
+			BUG_ON(err);
+			__free_page(page);
+			break;
+		}
+		cond_resched();
+	}
+}
+
+/* runs at idle priority so zeroing never competes with real work */
+static int nvmap_page_pool_refill_thread(void *data)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	unsigned int i;
+
+	sched_setscheduler(current, SCHED_IDLE, &param);
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(refill_wait,
+			refill_pending || kthread_should_stop());
+		refill_pending = false;
+
+		for (i = 0; i < NVMAP_NUM_POOLS; i++)
+			if (refill_pools[i])
+				nvmap_page_pool_refill(refill_pools[i]);
+	}
+	return 0;
 }
 
 static int nvmap_page_pool_get_unused_pages(void)
@@ -308,6 +613,76 @@ static struct kernel_param_ops shrink_ops = {
 module_param_cb(shrink_page_pools, &shrink_ops, &shrink_pp, 0644);
 #endif
 
+#if NVMAP_TEST_PAGE_POOL_BENCH
+static int bench_pp;
+static int bench_set(const char *arg, const struct kernel_param *kp)
+{
+	static const size_t sizes[] = { PAGE_SIZE, 4 * PAGE_SIZE,
+					16 * PAGE_SIZE, 64 * PAGE_SIZE };
+	struct nvmap_handle_ref **refs;
+	struct nvmap_client *client;
+	unsigned long long t1, t2, t3;
+	int err, count, i, n;
+
+	err = param_set_int(arg, kp);
+	if (err || bench_pp <= 0 || !nvmap_dev)
+		return err;
+	/*
+	 * Handles beyond the wc pool's size are not served by the pool and
+	 * would let the refs allocation below overflow, so clamp.
+	 */
+	bench_pp = min(bench_pp, nvmap_get_share_from_dev(nvmap_dev)->
+		       pools[NVMAP_HANDLE_WRITE_COMBINE].max_pages);
+	if (bench_pp <= 0)
+		return 0;
+
+	refs = vmalloc(bench_pp * sizeof(*refs));
+	client = nvmap_create_client(nvmap_dev, "page_pool_bench");
+	if (!refs || !client)
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		t1 = local_clock();
+		for (n = 0; n < bench_pp; n++) {
+			refs[n] = nvmap_alloc(client, sizes[i], PAGE_SIZE,
+					      NVMAP_HANDLE_WRITE_COMBINE,
+					      NVMAP_HEAP_IOVMM);
+			if (IS_ERR_OR_NULL(refs[n]))
+				break;
+		}
+		t2 = local_clock();
+		count = n;
+		while (n--)
+			nvmap_free(client, refs[n]);
+		t3 = local_clock();
+
+		if (!count)
+			continue;
+		pr_info("page pool bench: size=%zu handles=%d "
+			"alloc=%lluns/handle free=%lluns/handle",
+			sizes[i], count, div_u64(t2 - t1, count),
+			div_u64(t3 - t2, count));
+	}
+out:
+	if (client)
+		nvmap_client_put(client);
+	vfree(refs);
+	return 0;
+}
+
+static int bench_get(char *buff, const struct kernel_param *kp)
+{
+	return param_get_int(buff, kp);
+}
+
+static struct kernel_param_ops bench_ops = {
+	.get = bench_get,
+	.set = bench_set,
+};
+
+module_param_cb(bench_page_pools, &bench_ops, &bench_pp, 0644);
+#endif
+
 static int enable_pp_set(const char *arg, const struct kernel_param *kp)
 {
 	int total_pages, available_pages;
@@ -388,19 +763,33 @@ int nvmap_page_pool_init(struct nvmap_page_pool *pool, int flags)
 	int err;
 	struct page *page;
 	int highmem_pages = 0;
-	typedef int (*set_pages_array) (struct page **pages, int addrinarray);
-	set_pages_array s_cpa[] = {
-		set_pages_array_uc,
-		set_pages_array_wc,
-		set_pages_array_iwb,
-		set_pages_array_wb
-	};
 #endif
 
 	BUG_ON(flags >= NVMAP_NUM_POOLS);
 	memset(pool, 0x0, sizeof(*pool));
 	mutex_init(&pool->lock);
 	pool->flags = flags;
+	atomic_set(&pool->magazine_pages, 0);
+
+	pool->zeroed_array = kcalloc(NVMAP_POOL_ZEROED_PAGES,
+				     sizeof(struct page *), GFP_KERNEL);
+	pool->magazines = alloc_percpu(struct nvmap_page_magazine);
+	if (pool->magazines) {
+		int cpu;
+
+		for_each_possible_cpu(cpu)
+			spin_lock_init(&per_cpu_ptr(pool->magazines,
+						    cpu)->lock);
+	}
+	if (pool->zeroed_array)
+		refill_pools[flags] = pool;
+
+	if (!refill_task) {
+		refill_task = kthread_run(nvmap_page_pool_refill_thread, NULL,
+					  "nvmap_pool_refill");
+		if (IS_ERR(refill_task))
+			refill_task = NULL;
+	}
 
 	/* No default pool for cached memory. */
 	if (flags == NVMAP_HANDLE_CACHEABLE)
@@ -513,12 +902,8 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 	if (h->flags < NVMAP_NUM_POOLS)
 		pool = &share->pools[h->flags];
 
-	while (page_index < nr_page) {
-		if (!nvmap_page_pool_release(pool,
-		    h->pgalloc.pages[page_index]))
-			break;
-		page_index++;
-	}
+	page_index = nvmap_page_pool_release_pages(pool, h->pgalloc.pages,
+						   nr_page);
 #endif
 
 	if (page_index == nr_page)
@@ -579,6 +964,7 @@ static int handle_page_alloc(struct nvmap_client *client,
 #ifdef CONFIG_NVMAP_PAGE_POOLS
 	struct nvmap_page_pool *pool = NULL;
 	struct nvmap_share *share = nvmap_get_share_from_dev(h->dev);
+	int nr_zeroed;
 #endif
 	gfp_t gfp = GFP_NVMAP;
 	unsigned long kaddr;
@@ -614,31 +1000,30 @@ static int handle_page_alloc(struct nvmap_client *client,
 		if (h->flags < NVMAP_NUM_POOLS)
 			pool = &share->pools[h->flags];
 
-		for (i = 0; i < nr_page; i++) {
-			/* Get pages from pool, if available. */
-			pages[i] = nvmap_page_pool_alloc(pool);
-			if (!pages[i])
+		/* Get pages from pool, if available. */
+		page_index = nvmap_page_pool_alloc_pages(pool, pages, nr_page,
+				h->userflags & NVMAP_HANDLE_ZEROED_PAGES,
+				&nr_zeroed);
+
+		for (i = nr_zeroed; i < page_index; i++) {
+			if (!(h->userflags & NVMAP_HANDLE_ZEROED_PAGES))
 				break;
-			if (h->userflags & NVMAP_HANDLE_ZEROED_PAGES) {
-				/*
-				 * Just memset low mem pages; they will for
-				 * sure have a virtual address. Otherwise, build
-				 * a mapping for the page in the kernel.
-				 */
-				if (!PageHighMem(pages[i])) {
-					memset(page_address(pages[i]), 0,
-					       PAGE_SIZE);
-				} else {
-					paddr = page_to_phys(pages[i]);
-					set_pte_at(&init_mm, kaddr, *pte,
-						   pfn_pte(__phys_to_pfn(paddr),
-							   prot));
-					flush_tlb_kernel_page(kaddr);
-					memset((char *)kaddr, 0, PAGE_SIZE);
-				}
+			/*
+			 * Just memset low mem pages; they will for
+			 * sure have a virtual address. Otherwise, build
+			 * a mapping for the page in the kernel.
+			 */
+			if (!PageHighMem(pages[i])) {
+				memset(page_address(pages[i]), 0, PAGE_SIZE);
+			} else {
+				paddr = page_to_phys(pages[i]);
+				set_pte_at(&init_mm, kaddr, *pte,
+					   pfn_pte(__phys_to_pfn(paddr), prot));
+				flush_tlb_kernel_page(kaddr);
+				memset((char *)kaddr, 0, PAGE_SIZE);
 			}
-			page_index++;
 		}
+		i = page_index;
 #endif
 		for (; i < nr_page; i++) {
 			pages[i] = nvmap_alloc_pages_exact(gfp,	PAGE_SIZE);
@@ -796,10 +1181,16 @@ int nvmap_alloc_handle_id(struct nvmap_client *client,
 	if (!h)
 		return -EINVAL;
 
-	if (h->alloc) {
+	/* only the caller that claims the handle allocates and charges */
+	mutex_lock(&h->lock);
+	if (h->alloc || h->allocating) {
+		err = h->alloc ? -EEXIST : -EBUSY;
+		mutex_unlock(&h->lock);
 		nvmap_handle_put(h);
-		return -EEXIST;
+		return err;
 	}
+	h->allocating = true;
+	mutex_unlock(&h->lock);
 
 	trace_nvmap_alloc_handle_id(client, id, heap_mask, align, flags);
 	h->userflags = flags;
@@ -865,7 +1256,12 @@ int nvmap_alloc_handle_id(struct nvmap_client *client,
 	}
 
 out:
+	if (h->alloc)
+		nvmap_client_charge(client, h->size);
 	err = (h->alloc) ? 0 : err;
+	mutex_lock(&h->lock);
+	h->allocating = false;
+	mutex_unlock(&h->lock);
 	nvmap_handle_put(h);
 	return err;
 }
@@ -916,6 +1312,8 @@ void nvmap_free_handle_id(struct nvmap_client *client, unsigned long id)
 	pins = atomic_read(&ref->pin);
 	rb_erase(&ref->node, &client->handle_refs);
 
+	if (h->alloc)
+		nvmap_client_charge(client, -(long)h->size);
 	if (h->alloc && h->heap_pgalloc && !h->pgalloc.contig)
 		atomic_sub(h->size, &client->iovm_commit);
 
@@ -1104,6 +1502,7 @@ struct nvmap_handle_ref *nvmap_duplicate_handle_id(struct nvmap_client *client,
 		mutex_unlock(&h->lock);
 	}
 
+	nvmap_client_charge(client, h->size);
 	atomic_set(&ref->dupes, 1);
 	ref->handle = h;
 	atomic_set(&ref->pin, 0);
@@ -25,8 +25,10 @@
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/workqueue.h>
 
 #include <linux/nvmap.h>
 #include "nvmap.h"
@@ -35,6 +37,7 @@
 
 #include <asm/tlbflush.h>
 #include <asm/cacheflush.h>
+#include <asm/sizes.h>
 
 /*
  * "carveouts" are platform-defined regions of physically contiguous memory
@@ -72,6 +75,14 @@
 
 #define MAX_BUDDY_NR	128	/* maximum buddies in a buddy allocator */
 
+/* background compaction runs in steps of at most this long... */
+#define COMPACT_STEP_NS		(2 * NSEC_PER_MSEC)
+/* ...separated by this delay, to leave the heap lock to allocations */
+#define COMPACT_STEP_DELAY	msecs_to_jiffies(20)
+/* larger blocks are left to the foreground compaction, so that one copy
+ * does not run far past the step */
+#define COMPACT_BG_MAX_SIZE	SZ_2M
+
 enum direction {
 	TOP_DOWN,
 	BOTTOM_UP
@@ -94,6 +105,10 @@ struct heap_stat {
 	unsigned int compaction_count_fast;
 	/* full compaction attempt counter */
 	unsigned int compaction_count_full;
+	/* blocks relocated by the background compactor */
+	unsigned int compaction_count_background;
+	/* background relocations abandoned for a pin */
+	unsigned int compaction_count_cancelled;
 };
 
 struct buddy_heap;
@@ -112,6 +127,7 @@ struct list_block {
 	size_t align;
 	struct nvmap_heap *heap;
 	struct list_head free_list;
+	bool reserved;		/* background compaction destination */
 };
 
 struct combo_block {
@@ -144,6 +160,16 @@ struct nvmap_heap {
 	const char *name;
 	void *arg;
 	struct device dev;
+	unsigned int compact_fast;
+	unsigned int compact_full;
+	unsigned int compact_background;
+	unsigned int compact_cancelled;
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	/* compact in the background while the largest free extent is
+	 * smaller than this; 0 disables background compaction */
+	size_t compact_watermark;
+	struct delayed_work compact_work;
+#endif
 };
 
 static struct kmem_cache *buddy_heap_cache;
@@ -215,6 +241,11 @@ static phys_addr_t heap_stat(struct nvmap_heap *heap, struct heap_stat *stat)
 		stat->free_count++;
 		stat->free_largest = max(l->size, stat->free_largest);
 	}
+
+	stat->compaction_count_fast = heap->compact_fast;
+	stat->compaction_count_full = heap->compact_full;
+	stat->compaction_count_background = heap->compact_background;
+	stat->compaction_count_cancelled = heap->compact_cancelled;
 	mutex_unlock(&heap->lock);
 
 	return base;
@@ -247,9 +278,37 @@ static struct device_attribute heap_stat_free_size =
 static struct device_attribute heap_stat_base =
 	__ATTR(base, S_IRUGO, heap_stat_show, NULL);
 
+static struct device_attribute heap_stat_fragmentation =
+	__ATTR(fragmentation, S_IRUGO, heap_stat_show, NULL);
+
+static struct device_attribute heap_stat_compact_fast =
+	__ATTR(compact_fast, S_IRUGO, heap_stat_show, NULL);
+
+static struct device_attribute heap_stat_compact_full =
+	__ATTR(compact_full, S_IRUGO, heap_stat_show, NULL);
+
+static struct device_attribute heap_stat_compact_background =
+	__ATTR(compact_background, S_IRUGO, heap_stat_show, NULL);
+
+static struct device_attribute heap_stat_compact_cancelled =
+	__ATTR(compact_cancelled, S_IRUGO, heap_stat_show, NULL);
+
 static struct device_attribute heap_attr_name =
 	__ATTR(name, S_IRUGO, heap_name_show, NULL);
 
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+static ssize_t heap_compact_watermark_show(struct device *dev,
+			      struct device_attribute *attr, char *buf);
+
+static ssize_t heap_compact_watermark_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count);
+
+static struct device_attribute heap_attr_compact_watermark =
+	__ATTR(compact_watermark, S_IRUGO | S_IWUSR,
+	       heap_compact_watermark_show, heap_compact_watermark_store);
+#endif
+
 static struct attribute *heap_stat_attrs[] = {
 	&heap_stat_total_max.attr,
 	&heap_stat_total_count.attr,
@@ -258,7 +317,15 @@ static struct attribute *heap_stat_attrs[] = {
 	&heap_stat_free_count.attr,
 	&heap_stat_free_size.attr,
 	&heap_stat_base.attr,
+	&heap_stat_fragmentation.attr,
+	&heap_stat_compact_fast.attr,
+	&heap_stat_compact_full.attr,
+	&heap_stat_compact_background.attr,
+	&heap_stat_compact_cancelled.attr,
 	&heap_attr_name.attr,
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	&heap_attr_compact_watermark.attr,
+#endif
 	NULL,
 };
 
@@ -297,9 +364,46 @@ static ssize_t heap_stat_show(struct device *dev,
 		return sprintf(buf, "%u\n", stat.free);
 	else if (attr == &heap_stat_base)
 		return sprintf(buf, "%08llx\n", (unsigned long long)base);
+	else if (attr == &heap_stat_fragmentation)
+		/* share of the free space outside the largest free extent */
+		return sprintf(buf, "%u\n", stat.free ?
+			(stat.free - stat.free_largest) * 100 / stat.free : 0);
+	else if (attr == &heap_stat_compact_fast)
+		return sprintf(buf, "%u\n", stat.compaction_count_fast);
+	else if (attr == &heap_stat_compact_full)
+		return sprintf(buf, "%u\n", stat.compaction_count_full);
+	else if (attr == &heap_stat_compact_background)
+		return sprintf(buf, "%u\n", stat.compaction_count_background);
+	else if (attr == &heap_stat_compact_cancelled)
+		return sprintf(buf, "%u\n", stat.compaction_count_cancelled);
 	else
 		return -EINVAL;
 }
+
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+static ssize_t heap_compact_watermark_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct nvmap_heap *heap = container_of(dev, struct nvmap_heap, dev);
+	return sprintf(buf, "%zu\n", heap->compact_watermark);
+}
+
+static ssize_t heap_compact_watermark_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct nvmap_heap *heap = container_of(dev, struct nvmap_heap, dev);
+	unsigned long val;
+
+	if (kstrtoul(buf, 0, &val))
+		return -EINVAL;
+
+	mutex_lock(&heap->lock);
+	heap->compact_watermark = val;
+	mutex_unlock(&heap->lock);
+	return count;
+}
+#endif
 #ifndef CONFIG_NVMAP_CARVEOUT_COMPACTOR
 static struct nvmap_heap_block *buddy_alloc(struct buddy_heap *heap,
 					    size_t size, size_t align,
@@ -499,6 +603,7 @@ out:
 	b->heap = heap;
 	b->mem_prot = mem_prot;
 	b->align = align;
+	b->reserved = false;
 	return &b->block;
 }
 
@@ -619,7 +724,8 @@ static struct nvmap_heap_block *do_buddy_alloc(struct nvmap_heap *h,
 #ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
 
 static int do_heap_copy_listblock(struct nvmap_device *dev,
-		 phys_addr_t dst_base, phys_addr_t src_base, size_t len)
+		 phys_addr_t dst_base, phys_addr_t src_base, size_t len,
+		 atomic_t *cancel)
 {
 	pte_t **pte_src = NULL;
 	pte_t **pte_dst = NULL;
@@ -663,6 +769,11 @@ static int do_heap_copy_listblock(struct nvmap_device *dev,
 
 	for (page = 0; page < (len >> PAGE_SHIFT) ; page++) {
 
+		if (cancel && atomic_read(cancel)) {
+			error = -EINTR;
+			break;
+		}
+
 		pfn_src = __phys_to_pfn(phys_src) + page;
 		pfn_dst = __phys_to_pfn(phys_dst) + page;
 
@@ -701,6 +812,10 @@ static struct nvmap_heap_block *do_heap_relocate_listblock(
 	int error = 0;
 	struct nvmap_share *share;
 
+	/* destination of a background move, owned by the compactor */
+	if (block->reserved)
+		return NULL;
+
 	if (!handle) {
 		pr_err("INVALID HANDLE!\n");
 		return NULL;
@@ -753,7 +868,7 @@ static struct nvmap_heap_block *do_heap_relocate_listblock(
 
 	if (dst_base != src_base) {
 		error = do_heap_copy_listblock(handle->dev,
-					dst_base, src_base, src_size);
+					dst_base, src_base, src_size, NULL);
 		BUG_ON(error);
 	}
 
@@ -837,6 +952,224 @@ static void nvmap_heap_compact(struct nvmap_heap *heap,
 	}
 	pr_err("Relocated %d chunks\n", relocation_count);
 }
+
+/*
+ * A background relocation in flight. The destination is reserved under the
+ * heap lock, the data is copied with no lock held, and the move is committed
+ * under the heap lock again only if the source is still the handle's block
+ * and the handle was neither pinned nor mapped in the meantime.
+ */
+struct compact_move {
+	struct nvmap_handle *handle;
+	struct nvmap_heap_block *src;
+	struct nvmap_heap_block *dst;
+	phys_addr_t src_base;
+	size_t size;
+};
+
+/*
+ * Reserves a lower destination for @block and takes a reference on its
+ * handle, which the caller drops after the heap lock is released.
+ * Returns 0 if the move was set up, -EBUSY if the block can't be moved now
+ * and -EINTR if its handle was pinned or mapped after the reference was
+ * taken. Must be called while holding the heap's lock.
+ */
+static int do_heap_relocate_prepare_bg(struct list_block *block,
+				       struct compact_move *move)
+{
+	struct nvmap_handle *handle = block->block.handle;
+
+	if (!handle || block->size > COMPACT_BG_MAX_SIZE)
+		return -EBUSY;
+	if (atomic_read(&handle->pin) || handle->usecount)
+		return -EBUSY;
+
+	move->dst = do_heap_alloc(block->heap, block->size, block->align,
+				  block->mem_prot, block->block.base);
+	if (!move->dst)
+		return -EBUSY;
+
+	BUG_ON(move->dst->base >= block->block.base);
+	container_of(move->dst, struct list_block, block)->reserved = true;
+
+	/* the handle is being freed, which waits for the heap lock */
+	if (!atomic_inc_not_zero(&handle->ref)) {
+		do_heap_free(move->dst);
+		return -EBUSY;
+	}
+
+	move->handle = handle;
+	move->src = &block->block;
+	move->src_base = block->block.base;
+	move->size = block->size;
+
+	/* pairs with the barrier in nvmap_heap_compact_cancel(): either the
+	 * pin or use count is seen here, or the cancel comes after this */
+	atomic_set(&handle->compact_cancel, 0);
+	smp_mb();
+	if (atomic_read(&handle->pin) || handle->usecount) {
+		do_heap_free(move->dst);
+		return -EINTR;
+	}
+	return 0;
+}
+
+/*
+ * Finishes a move set up by do_heap_relocate_prepare_bg(), given the result
+ * of the copy. Nothing is waited for: if the handle or the pin lock is busy
+ * the move is dropped. Must be called while holding the heap's lock.
+ */
+static int do_heap_relocate_commit_bg(struct compact_move *move, int err)
+{
+	struct nvmap_handle *handle = move->handle;
+	struct nvmap_share *share = nvmap_get_share_from_dev(handle->dev);
+
+	if (err)
+		goto fail;
+
+	err = -EBUSY;
+	if (!mutex_trylock(&handle->lock))
+		goto fail;
+	if (!mutex_trylock(&share->pin_lock)) {
+		mutex_unlock(&handle->lock);
+		goto fail;
+	}
+
+	/* a foreground compaction may have moved the source meanwhile */
+	if (handle->carveout != move->src || move->src->base != move->src_base)
+		goto out;
+
+	if (atomic_read(&handle->compact_cancel) ||
+	    atomic_read(&handle->pin) || handle->usecount) {
+		err = -EINTR;
+		goto out;
+	}
+
+	do_heap_free(move->src);
+	handle->carveout = move->dst;
+	move->dst->handle = handle;
+	container_of(move->dst, struct list_block, block)->reserved = false;
+	err = 0;
+out:
+	mutex_unlock(&share->pin_lock);
+	mutex_unlock(&handle->lock);
+fail:
+	if (err)
+		do_heap_free(move->dst);
+	return err;
+}
+
+/* must be called while holding the heap's lock */
+static bool nvmap_heap_fragmented(struct nvmap_heap *heap)
+{
+	struct list_block *l;
+	size_t free = 0;
+	size_t free_largest = 0;
+
+	if (!heap->compact_watermark)
+		return false;
+
+	list_for_each_entry(l, &heap->free_list, free_list) {
+		free += l->size;
+		free_largest = max(free_largest, l->size);
+	}
+
+	/* compaction can only help if there is enough free space in total */
+	return free_largest < heap->compact_watermark &&
+		free >= heap->compact_watermark;
+}
+
+/*
+ * Sets up the move of the first movable block which sits right above a
+ * free extent down into the lowest free extent it fits in. Returns 0 if a
+ * move was set up, -ENOENT if no block can be moved and -EINTR if the move
+ * was cancelled before it started. Must be called while holding the heap's
+ * lock.
+ */
+static int nvmap_heap_compact_prepare(struct nvmap_heap *heap,
+				      struct compact_move *move)
+{
+	struct list_block *hole;
+	struct list_block *next;
+	int err;
+
+	if (!nvmap_heap_fragmented(heap))
+		return -ENOENT;
+
+	list_for_each_entry(hole, &heap->free_list, free_list) {
+		if (list_is_last(&hole->all_list, &heap->all_list))
+			break;
+
+		next = list_entry(hole->all_list.next, struct list_block,
+				  all_list);
+		if (next->block.type != BLOCK_FIRST_FIT)
+			continue;
+
+		err = do_heap_relocate_prepare_bg(next, move);
+		if (err != -EBUSY)
+			return err;
+	}
+	return -ENOENT;
+}
+
+static void nvmap_heap_compact_work(struct work_struct *work)
+{
+	struct nvmap_heap *heap = container_of(to_delayed_work(work),
+					struct nvmap_heap, compact_work);
+	u64 deadline = local_clock() + COMPACT_STEP_NS;
+	struct compact_move move;
+	int ret;
+
+	for (;;) {
+		mutex_lock(&heap->lock);
+		ret = nvmap_heap_compact_prepare(heap, &move);
+		if (ret == -EINTR)
+			heap->compact_cancelled++;
+		mutex_unlock(&heap->lock);
+		if (ret == -ENOENT)
+			return;
+
+		if (!ret) {
+			ret = do_heap_copy_listblock(move.handle->dev,
+					move.dst->base, move.src_base,
+					move.size, &move.handle->compact_cancel);
+
+			mutex_lock(&heap->lock);
+			ret = do_heap_relocate_commit_bg(&move, ret);
+			if (ret == -EINTR)
+				heap->compact_cancelled++;
+			else if (!ret)
+				heap->compact_background++;
+			mutex_unlock(&heap->lock);
+		}
+
+		/* dropping the last reference frees into the heap */
+		nvmap_handle_put(move.handle);
+
+		if (ret || local_clock() >= deadline)
+			break;
+	}
+
+	schedule_delayed_work(&heap->compact_work, COMPACT_STEP_DELAY);
+}
+
+/* must be called while holding the heap's lock */
+static void nvmap_heap_compact_kick(struct nvmap_heap *heap)
+{
+	if (nvmap_heap_fragmented(heap))
+		schedule_delayed_work(&heap->compact_work, COMPACT_STEP_DELAY);
+}
+
+/*
+ * Called once a carveout handle has been pinned or mapped, after the pin or
+ * use count was raised, so that a background move of it which started
+ * before is not committed.
+ */
+void nvmap_heap_compact_cancel(struct nvmap_handle *h)
+{
+	smp_mb();
+	atomic_set(&h->compact_cancel, 1);
+}
 #endif
 
 void nvmap_usecount_inc(struct nvmap_handle *h)
@@ -844,6 +1177,7 @@ void nvmap_usecount_inc(struct nvmap_handle *h)
 	if (h->alloc && !h->heap_pgalloc) {
 		mutex_lock(&h->lock);
 		h->usecount++;
+		nvmap_heap_compact_cancel(h);
 		mutex_unlock(&h->lock);
 	} else {
 		h->usecount++;
@@ -875,10 +1209,12 @@ struct nvmap_heap_block *nvmap_heap_alloc(struct nvmap_heap *h,
 	b = do_heap_alloc(h, len, align, prot, 0);
 	if (!b) {
 		pr_err("Compaction triggered!\n");
+		h->compact_fast++;
 		nvmap_heap_compact(h, len, true);
 		b = do_heap_alloc(h, len, align, prot, 0);
 		if (!b) {
 			pr_err("Full compaction triggered!\n");
+			h->compact_full++;
 			nvmap_heap_compact(h, len, false);
 			b = do_heap_alloc(h, len, align, prot, 0);
 		}
@@ -929,6 +1265,9 @@ void nvmap_heap_free(struct nvmap_heap_block *b)
 		lb = container_of(b, struct list_block, block);
 		nvmap_flush_heap_block(NULL, b, lb->size, lb->mem_prot);
 		do_heap_free(b);
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+		nvmap_heap_compact_kick(h);
+#endif
 	}
 
 	if (bh) {
@@ -1023,6 +1362,10 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 	INIT_LIST_HEAD(&h->buddy_list);
 	INIT_LIST_HEAD(&h->all_list);
 	mutex_init(&h->lock);
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	h->compact_watermark = len / 8;
+	INIT_DELAYED_WORK(&h->compact_work, nvmap_heap_compact_work);
+#endif
 	l->block.base = base;
 	l->block.type = BLOCK_EMPTY;
 	l->size = len;
@@ -1060,6 +1403,9 @@ void nvmap_heap_destroy(struct nvmap_heap *heap)
 {
 	WARN_ON(!list_empty(&heap->buddy_list));
 
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	cancel_delayed_work_sync(&heap->compact_work);
+#endif
 	sysfs_remove_group(&heap->dev.kobj, &heap_stat_attr_group);
 	device_unregister(&heap->dev);
 
@@ -65,4 +65,12 @@ void nvmap_heap_deinit(void);
 int nvmap_flush_heap_block(struct nvmap_client *client,
 	struct nvmap_heap_block *block, size_t len, unsigned int prot);
 
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+void nvmap_heap_compact_cancel(struct nvmap_handle *h);
+#else
+static inline void nvmap_heap_compact_cancel(struct nvmap_handle *h)
+{
+}
+#endif
+
 #endif
@@ -23,12 +23,16 @@
 #include <linux/dma-mapping.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/uaccess.h>
 #include <linux/nvmap.h>
 
 #include <asm/cacheflush.h>
 #include <asm/outercache.h>
+#include <asm/sizes.h>
 #include <asm/tlbflush.h>
 
 #include <mach/iovmm.h>
@@ -46,6 +50,8 @@
 
 #define FLUSH_ALL_HANDLES		0
 
+#define CACHE_LIST_MAX_RANGES	(PAGE_SIZE / sizeof(struct nvmap_cache_range))
+
 static ssize_t rw_handle(struct nvmap_client *client, struct nvmap_handle *h,
 			 int is_read, unsigned long h_offs,
 			 unsigned long sys_addr, unsigned long h_stride,
@@ -559,6 +565,20 @@ static void heap_page_cache_maint(
 	}
 }
 
+static void handle_outer_cache_maint(struct nvmap_handle *h,
+	unsigned long start, unsigned long end, unsigned int op)
+{
+	if (h->heap_pgalloc) {
+		heap_page_cache_maint(h, start, end, op, false, true,
+				      NULL, 0, 0);
+	} else {
+		phys_addr_t pstart;
+
+		pstart = start + h->carveout->base;
+		outer_cache_maint(op, pstart, end - start);
+	}
+}
+
 #if defined(CONFIG_NVMAP_OUTER_CACHE_MAINT_BY_SET_WAYS)
 static bool fast_cache_maint_outer(unsigned long start,
 		unsigned long end, unsigned int op)
@@ -601,18 +621,8 @@ static bool fast_cache_maint(struct nvmap_handle *h,
 
 	/* outer maintenance */
 	if (h->flags != NVMAP_HANDLE_INNER_CACHEABLE) {
-		if(!fast_cache_maint_outer(start, end, op))
-		{
-			if (h->heap_pgalloc) {
-				heap_page_cache_maint(h, start,
-					end, op, false, true, NULL, 0, 0);
-			} else  {
-				phys_addr_t pstart;
-
-				pstart = start + h->carveout->base;
-				outer_cache_maint(op, pstart, end - start);
-			}
-		}
+		if (!fast_cache_maint_outer(start, end, op))
+			handle_outer_cache_maint(h, start, end, op);
 	}
 	return true;
 }
@@ -687,6 +697,16 @@ static void debug_count_flushed_op(struct nvmap_deferred_ops *deferred_ops,
 	}
 }
 
+static void cache_maint_account(struct nvmap_client *client, size_t bytes,
+				unsigned int full, ktime_t start)
+{
+	atomic64_add(bytes, &client->cache_maint_bytes);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &client->cache_maint_ns);
+	if (full)
+		atomic_add(full, &client->cache_maint_full);
+}
+
 struct cache_maint_op {
 	struct list_head list_data;
 	phys_addr_t start;
@@ -707,6 +727,7 @@ static void cache_maint_work_funct(struct cache_maint_op *cache_work)
 	phys_addr_t pend = cache_work->end;
 	phys_addr_t loop;
 	int err = 0;
+	bool done;
 	struct nvmap_handle *h = cache_work->h;
 	struct nvmap_client *client = h->owner;
 	unsigned int op = cache_work->op;
@@ -730,7 +751,27 @@ static void cache_maint_work_funct(struct cache_maint_op *cache_work)
 	    h->flags == NVMAP_HANDLE_WRITE_COMBINE || pstart == pend)
 		goto out;
 
-	if (fast_cache_maint(h, pstart, pend, op))
+	if (pstart > h->size || pend > h->size) {
+		pr_warn("cache maintenance outside handle\n");
+		cache_work->error = -EINVAL;
+		goto out;
+	}
+
+	/* inner caches were already maintained by set/ways */
+	if (!cache_work->inner) {
+		if (cache_work->outer) {
+			/* lock carveout from relocation by mapcount */
+			nvmap_usecount_inc(h);
+			handle_outer_cache_maint(h, pstart, pend, op);
+			nvmap_usecount_dec(h);
+		}
+		goto out;
+	}
+
+	nvmap_usecount_inc(h);
+	done = fast_cache_maint(h, pstart, pend, op);
+	nvmap_usecount_dec(h);
+	if (done)
 		goto out;
 
 	prot = nvmap_pgprot(h, pgprot_kernel);
@@ -743,15 +784,7 @@ static void cache_maint_work_funct(struct cache_maint_op *cache_work)
 
 	if (h->heap_pgalloc) {
 		heap_page_cache_maint(h, pstart, pend, op, true,
-			(h->flags == NVMAP_HANDLE_INNER_CACHEABLE) ?
-					false : true,
-			pte, kaddr, prot);
-		goto out;
-	}
-
-	if (pstart > h->size || pend > h->size) {
-		pr_warn("cache maintenance outside handle\n");
-		cache_work->error = -EINVAL;
+			cache_work->outer, pte, kaddr, prot);
 		goto out;
 	}
 
@@ -776,7 +809,7 @@ static void cache_maint_work_funct(struct cache_maint_op *cache_work)
 		loop = next;
 	}
 
-	if (h->flags != NVMAP_HANDLE_INNER_CACHEABLE)
+	if (cache_work->outer)
 		outer_cache_maint(op, pstart, pend - pstart);
 
 	/* unlock carveout */
@@ -994,6 +1027,8 @@ static int cache_maint(struct nvmap_client *client,
 		spin_unlock(&deferred_ops->deferred_ops_lock);
 	} else {
 		struct cache_maint_op cache_op;
+		ktime_t t = ktime_get();
+		unsigned int full = 0;
 
 		cache_op.h = h;
 		cache_op.start = start;
@@ -1001,9 +1036,17 @@ static int cache_maint(struct nvmap_client *client,
 		cache_op.op = op;
 		cache_op.inner = inner_maint;
 		cache_op.outer = outer_maint;
+		cache_op.error = 0;
 
 		cache_maint_work_funct(&cache_op);
 
+#ifdef CONFIG_NVMAP_CACHE_MAINT_BY_SET_WAYS
+		full = inner_maint && op != NVMAP_CACHE_OP_INV &&
+			end - start >= cache_maint_inner_threshold;
+#endif
+		if (inner_maint || outer_maint)
+			cache_maint_account(client, end - start, full, t);
+
 		if (op == NVMAP_CACHE_OP_WB_INV) {
 			spin_lock(&deferred_ops->deferred_ops_lock);
 			debug_count_flushed_op(deferred_ops,
@@ -1017,6 +1060,299 @@ static int cache_maint(struct nvmap_client *client,
 	return 0;
 }
 
+/* write-backs go first so that an invalidate in the same list never
+ * discards data which another entry asked to have written back */
+static const int cache_op_order[] = {
+	[NVMAP_CACHE_OP_WB] = 0,
+	[NVMAP_CACHE_OP_WB_INV] = 1,
+	[NVMAP_CACHE_OP_INV] = 2,
+};
+
+static int cache_range_cmp(const void *a, const void *b)
+{
+	const struct nvmap_cache_range *ra = a;
+	const struct nvmap_cache_range *rb = b;
+
+	if (ra->op != rb->op)
+		return cache_op_order[ra->op] - cache_op_order[rb->op];
+	if (ra->handle != rb->handle)
+		return ra->handle < rb->handle ? -1 : 1;
+	if (ra->offset != rb->offset)
+		return ra->offset < rb->offset ? -1 : 1;
+	return 0;
+}
+
+/* coalesces sorted ranges in place, returns the new number of ranges */
+static unsigned int cache_range_merge(struct nvmap_cache_range *r,
+				      unsigned int count)
+{
+	unsigned int i, n = 0;
+
+	for (i = 1; i < count; i++) {
+		struct nvmap_cache_range *cur = &r[n];
+		u32 end = cur->offset + cur->len;
+
+		if (r[i].op == cur->op && r[i].handle == cur->handle &&
+		    r[i].offset <= end) {
+			end = max(end, r[i].offset + r[i].len);
+			cur->len = end - cur->offset;
+			continue;
+		}
+		r[++n] = r[i];
+	}
+	return n + 1;
+}
+
+/*
+ * Maintains the leading run of ops sharing the same cache op and returns its
+ * length. The run is costed as a whole: when its total size is past the
+ * calibrated crossover a single set/way operation covers every range in it,
+ * otherwise each range is maintained by address.
+ */
+static unsigned int cache_maint_run(struct nvmap_client *client,
+				    struct cache_maint_op *ops,
+				    unsigned int count, int *err)
+{
+	unsigned int op = ops[0].op;
+	size_t inner_size = 0;
+	size_t outer_size = 0;
+	bool inner_all = false;
+	bool outer_all = false;
+	unsigned int i, n;
+	ktime_t t = ktime_get();
+
+	for (n = 0; n < count && ops[n].op == op; n++) {
+		size_t len = ops[n].end - ops[n].start;
+
+		if (ops[n].inner)
+			inner_size += len;
+		if (ops[n].outer)
+			outer_size += len;
+	}
+
+#ifdef CONFIG_NVMAP_CACHE_MAINT_BY_SET_WAYS
+	if (op != NVMAP_CACHE_OP_INV &&
+	    inner_size >= cache_maint_inner_threshold) {
+		if (op == NVMAP_CACHE_OP_WB_INV)
+			inner_flush_cache_all();
+		else
+			inner_clean_cache_all();
+		inner_all = true;
+	}
+#endif
+#ifdef CONFIG_NVMAP_OUTER_CACHE_MAINT_BY_SET_WAYS
+	/* done after the inner pass below, so L1 write-backs reach DRAM */
+	outer_all = op != NVMAP_CACHE_OP_INV &&
+		    outer_size >= cache_maint_outer_threshold;
+#endif
+
+	for (i = 0; i < n; i++) {
+		struct nvmap_handle *h = ops[i].h;
+
+		if (op == NVMAP_CACHE_OP_INV &&
+		    nvmap_find_cache_maint_op(h->dev, h)) {
+			struct nvmap_share *share =
+				nvmap_get_share_from_dev(h->dev);
+			mutex_lock(&share->pin_lock);
+			nvmap_cache_maint_ops_flush(h->dev, h);
+			mutex_unlock(&share->pin_lock);
+		}
+
+		if (inner_all)
+			ops[i].inner = false;
+		if (outer_all)
+			ops[i].outer = false;
+		if (!ops[i].inner && !ops[i].outer)
+			continue;
+
+		cache_maint_work_funct(&ops[i]);
+		if (ops[i].error && !*err)
+			*err = ops[i].error;
+	}
+
+	if (outer_all)
+		fast_cache_maint_outer(0, outer_size, op);
+
+	cache_maint_account(client, inner_size, inner_all + outer_all, t);
+	return n;
+}
+
+int nvmap_ioctl_cache_maint_list(struct file *filp, void __user *arg)
+{
+	struct nvmap_client *client = filp->private_data;
+	struct nvmap_cache_list list;
+	struct nvmap_cache_range *ranges;
+	struct cache_maint_op *ops;
+	unsigned int i, count;
+	int err = 0;
+
+	if (copy_from_user(&list, arg, sizeof(list)))
+		return -EFAULT;
+
+	if (!list.count)
+		return 0;
+
+	if (!list.ranges || list.count > CACHE_LIST_MAX_RANGES)
+		return -EINVAL;
+
+	ranges = kmalloc(list.count * sizeof(*ranges), GFP_KERNEL);
+	ops = kcalloc(list.count, sizeof(*ops), GFP_KERNEL);
+	if (!ranges || !ops) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	if (copy_from_user(ranges, (void __user *)list.ranges,
+			   list.count * sizeof(*ranges))) {
+		err = -EFAULT;
+		goto out;
+	}
+
+	for (i = 0; i < list.count; i++) {
+		struct nvmap_cache_range *r = &ranges[i];
+
+		if (!r->handle || r->op < NVMAP_CACHE_OP_WB ||
+		    r->op > NVMAP_CACHE_OP_WB_INV ||
+		    r->offset + r->len < r->offset) {
+			err = -EINVAL;
+			goto out;
+		}
+	}
+
+	sort(ranges, list.count, sizeof(*ranges), cache_range_cmp, NULL);
+	count = cache_range_merge(ranges, list.count);
+
+	for (i = 0; i < count; i++) {
+		struct nvmap_handle *h;
+
+		h = nvmap_get_handle_id(client, ranges[i].handle);
+		if (!h) {
+			err = -EPERM;
+			goto put;
+		}
+		ops[i].h = h;
+
+		if (!h->alloc || ranges[i].offset + ranges[i].len > h->size) {
+			err = -EINVAL;
+			goto put;
+		}
+
+		ops[i].start = ranges[i].offset;
+		ops[i].end = ranges[i].offset + ranges[i].len;
+		ops[i].op = ranges[i].op;
+		ops[i].inner = h->flags == NVMAP_HANDLE_CACHEABLE ||
+			       h->flags == NVMAP_HANDLE_INNER_CACHEABLE;
+#ifdef CONFIG_OUTER_CACHE
+		ops[i].outer = h->flags == NVMAP_HANDLE_CACHEABLE;
+#endif
+	}
+
+	for (i = 0; i < count; )
+		i += cache_maint_run(client, ops + i, count - i, &err);
+
+put:
+	for (i = 0; i < count && ops[i].h; i++)
+		nvmap_handle_put(ops[i].h);
+out:
+	kfree(ops);
+	kfree(ranges);
+	return err;
+}
+
+#ifdef CONFIG_NVMAP_CACHE_MAINT_BY_SET_WAYS
+#define CALIBRATE_ORDER		6	/* 256KiB */
+#define CALIBRATE_RUNS		4
+#define CALIBRATE_MAX_THRESHOLD	SZ_16M
+
+static u64 calibrate_ns_since(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* size at which maintaining by address costs as much as by set/ways */
+static size_t calibrate_crossover(u64 all_ns, u64 range_ns, size_t size)
+{
+	u64 bytes;
+
+	if (!range_ns)
+		return CALIBRATE_MAX_THRESHOLD;
+
+	bytes = div64_u64(all_ns * size, range_ns);
+	bytes = clamp_t(u64, bytes, PAGE_SIZE, CALIBRATE_MAX_THRESHOLD);
+	return PAGE_ALIGN(bytes);
+}
+
+/*
+ * Times a flush of a dirty buffer by address against a flush of the whole
+ * cache by set/ways and derives the thresholds above which the latter is
+ * cheaper. The best of several runs is used to filter out interruptions.
+ */
+void nvmap_cache_maint_calibrate(struct device *dev)
+{
+	size_t size = PAGE_SIZE << CALIBRATE_ORDER;
+	u64 inner_range = ULLONG_MAX;
+	u64 inner_all = ULLONG_MAX;
+	u64 outer_range = ULLONG_MAX;
+	u64 outer_all = ULLONG_MAX;
+	struct page *page;
+	phys_addr_t paddr;
+	void *vaddr;
+	ktime_t t;
+	int i;
+
+	page = alloc_pages(GFP_KERNEL, CALIBRATE_ORDER);
+	if (!page) {
+		dev_warn(dev, "no memory to calibrate cache maintenance\n");
+		return;
+	}
+	vaddr = page_address(page);
+	paddr = page_to_phys(page);
+
+	for (i = 0; i < CALIBRATE_RUNS; i++) {
+		memset(vaddr, i, size);
+		t = ktime_get();
+		inner_cache_maint(NVMAP_CACHE_OP_WB_INV, vaddr, size);
+		inner_range = min(inner_range, calibrate_ns_since(t));
+		t = ktime_get();
+		outer_cache_maint(NVMAP_CACHE_OP_WB_INV, paddr, size);
+		outer_range = min(outer_range, calibrate_ns_since(t));
+
+		memset(vaddr, i, size);
+		t = ktime_get();
+		inner_flush_cache_all();
+		inner_all = min(inner_all, calibrate_ns_since(t));
+#ifdef CONFIG_NVMAP_OUTER_CACHE_MAINT_BY_SET_WAYS
+		t = ktime_get();
+		outer_flush_all();
+		outer_all = min(outer_all, calibrate_ns_since(t));
+#endif
+	}
+	__free_pages(page, CALIBRATE_ORDER);
+
+	cache_maint_inner_threshold =
+		calibrate_crossover(inner_all, inner_range, size);
+	dev_info(dev, "inner cache maintenance by set/ways from %zuKiB\n",
+		 cache_maint_inner_threshold >> 10);
+
+#ifdef CONFIG_NVMAP_OUTER_CACHE_MAINT_BY_SET_WAYS
+	/* the deferred flush path relies on the outer threshold being the
+	 * larger of the two */
+	cache_maint_outer_threshold =
+		max(calibrate_crossover(outer_all, outer_range, size),
+		    cache_maint_inner_threshold + PAGE_SIZE);
+	dev_info(dev, "outer cache maintenance by set/ways from %zuKiB\n",
+		 cache_maint_outer_threshold >> 10);
+#else
+	(void)outer_range;
+	(void)outer_all;
+#endif
+}
+#else
+void nvmap_cache_maint_calibrate(struct device *dev)
+{
+}
+#endif
+
 static int rw_handle_page(struct nvmap_handle *h, int is_read,
 			  unsigned long start, unsigned long rw_addr,
 			  unsigned long bytes, unsigned long kaddr, pte_t *pte)
@@ -98,6 +98,18 @@ struct nvmap_cache_op {
 	__s32 op;
 };
 
+struct nvmap_cache_range {
+	__u32 handle;		/* hmem */
+	__u32 offset;		/* offset into hmem */
+	__u32 len;		/* number of bytes to maintain */
+	__s32 op;		/* NVMAP_CACHE_OP_* */
+};
+
+struct nvmap_cache_list {
+	unsigned long ranges;	/* array of struct nvmap_cache_range */
+	__u32 count;		/* number of entries in ranges */
+};
+
 #define NVMAP_IOC_MAGIC 'N'
 
 /* Creates a new memory handle. On input, the argument is the size of the new
@@ -141,7 +153,12 @@ struct nvmap_cache_op {
  * reference to the same handle */
 #define NVMAP_IOC_SHARE  _IOWR(NVMAP_IOC_MAGIC, 14, struct nvmap_create_handle)
 
-#define NVMAP_IOC_MAXNR (_IOC_NR(NVMAP_IOC_SHARE))
+/* Performs cache maintenance on a list of handle ranges. Adjacent and
+ * overlapping ranges of the same handle and op are merged, and all write-backs
+ * are issued before any invalidates. Handles need not be mapped. */
+#define NVMAP_IOC_CACHE_LIST _IOW(NVMAP_IOC_MAGIC, 15, struct nvmap_cache_list)
+
+#define NVMAP_IOC_MAXNR (_IOC_NR(NVMAP_IOC_CACHE_LIST))
 
 #ifdef  __KERNEL__
 int nvmap_ioctl_pinop(struct file *filp, bool is_pin, void __user *arg);
@@ -160,6 +177,8 @@ int nvmap_map_into_caller_ptr(struct file *filp, void __user *arg);
 
 int nvmap_ioctl_cache_maint(struct file *filp, void __user *arg);
 
+int nvmap_ioctl_cache_maint_list(struct file *filp, void __user *arg);
+
 int nvmap_ioctl_rw_handle(struct file *filp, int is_read, void __user* arg);
 
 #ifdef CONFIG_DMA_SHARED_BUFFER
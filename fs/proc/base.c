@@ -496,6 +496,17 @@ static int proc_oom_score(struct task_struct *task, char *buffer)
 	return sprintf(buffer, "%lu\n", points);
 }
 
+static int proc_pid_drvmem(struct task_struct *task, char *buffer)
+{
+	return sprintf(buffer,
+		       "Ashmem:\t%8lu kB\n"
+		       "Binder:\t%8lu kB\n"
+		       "Nvmap:\t%8lu kB\n",
+		       task_drvmem(task, DRVMEM_ASHMEM) >> 10,
+		       task_drvmem(task, DRVMEM_BINDER) >> 10,
+		       task_drvmem(task, DRVMEM_NVMAP) >> 10);
+}
+
 struct limit_names {
 	char *name;
 	char *unit;
@@ -1140,6 +1151,8 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	if (!err)
+		oom_adj_notify(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -1268,6 +1281,8 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	if (!err)
+		oom_adj_notify(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -2839,6 +2854,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 	INF("cmdline",    S_IRUGO, proc_pid_cmdline),
 	ONE("stat",       S_IRUGO, proc_tgid_stat),
 	ONE("statm",      S_IRUGO, proc_pid_statm),
+	INF("drvmem",     S_IRUGO, proc_pid_drvmem),
 	REG("maps",       S_IRUGO, proc_maps_operations),
 #ifdef CONFIG_NUMA
 	REG("numa_maps",  S_IRUGO, proc_numa_maps_operations),
@@ -340,6 +340,46 @@ static inline unsigned int cpufreq_quick_get_max(unsigned int cpu)
 }
 #endif
 
+/*
+ * scheduler driven governor input: the hook is called on every wakeup
+ * enqueue and scheduler tick with the rq lock of @cpu held, so it must
+ * not take locks or wake up tasks itself.
+ */
+#ifdef CONFIG_CPU_FREQ
+void cpufreq_sched_set_hook(void (*hook)(int cpu, unsigned long nr_running));
+#else
+static inline void cpufreq_sched_set_hook(
+	void (*hook)(int cpu, unsigned long nr_running))
+{
+}
+#endif
+
+/*
+ * per task group frequency floor (cpu.freq_boost_min): returns the floor
+ * in kHz of the group running on @cpu, or 0. The hook is called from
+ * irq_work on @cpu when its floor got raised by a context switch.
+ */
+#ifdef CONFIG_CGROUP_FREQ_BOOST
+unsigned int cpufreq_boost_floor(int cpu);
+void cpufreq_boost_set_hook(void (*hook)(int cpu, unsigned int floor));
+void cpufreq_boost_clear_hook(void (*hook)(int cpu, unsigned int floor));
+#else
+static inline unsigned int cpufreq_boost_floor(int cpu)
+{
+	return 0;
+}
+
+static inline void cpufreq_boost_set_hook(
+	void (*hook)(int cpu, unsigned int floor))
+{
+}
+
+static inline void cpufreq_boost_clear_hook(
+	void (*hook)(int cpu, unsigned int floor))
+{
+}
+#endif
+
 
 /*********************************************************************
  *                       CPUFREQ DEFAULT GOVERNOR                    *
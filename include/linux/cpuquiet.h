@@ -0,0 +1,116 @@
+/*
+ * include/linux/cpuquiet.h
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _LINUX_CPUQUIET_H
+#define _LINUX_CPUQUIET_H
+
+#include <linux/kobject.h>
+#include <linux/list.h>
+#include <linux/sysfs.h>
+
+#define CPUQUIET_NAME_LEN 16
+
+/*
+ * A governor decides which cores should be running. It never touches
+ * the hardware itself, it asks the registered driver through
+ * cpuquiet_wake_cpu()/cpuquiet_quiesence_cpu().
+ */
+struct cpuquiet_governor {
+	char			name[CPUQUIET_NAME_LEN];
+	struct list_head	governor_list;
+	int (*start)		(void);
+	void (*stop)		(void);
+	int (*store_active)	(unsigned int cpu, bool active);
+	void (*device_free_notification) (void);
+	void (*device_busy_notification) (void);
+	struct module		*owner;
+};
+
+/*
+ * A driver knows how to bring a core in and out of the quiescent state
+ * on a given platform (plain hotplug, cluster switching, ...).
+ */
+struct cpuquiet_driver {
+	char			name[CPUQUIET_NAME_LEN];
+	int (*quiesence_cpu)	(unsigned int cpunumber);
+	int (*wake_cpu)		(unsigned int cpunumber);
+};
+
+extern int cpuquiet_register_governor(struct cpuquiet_governor *gov);
+extern void cpuquiet_unregister_governor(struct cpuquiet_governor *gov);
+extern int cpuquiet_quiesence_cpu(unsigned int cpunumber);
+extern int cpuquiet_wake_cpu(unsigned int cpunumber);
+extern int cpuquiet_register_driver(struct cpuquiet_driver *drv);
+extern void cpuquiet_unregister_driver(struct cpuquiet_driver *drv);
+extern int cpuquiet_kobject_init(struct kobject *kobj, struct kobj_type *type,
+				char *name);
+extern void cpuquiet_device_busy(void);
+extern void cpuquiet_device_free(void);
+
+/* auto sysfs attributes for governors and drivers */
+struct cpuquiet_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct cpuquiet_attribute *attr, char *buf);
+	ssize_t (*store)(struct cpuquiet_attribute *attr, const char *buf,
+				size_t count);
+	/* Optional. Called after store is called */
+	void (*store_callback)(struct cpuquiet_attribute *attr);
+	void *param;
+};
+
+#define CPQ_BASIC_ATTRIBUTE(_name, _mode, _type) \
+	static struct cpuquiet_attribute _name ## _attr = {		\
+		.attr = {.name = __stringify(_name), .mode = _mode },	\
+		.show = show_ ## _type ## _attribute,			\
+		.store = store_ ## _type ## _attribute,			\
+		.param = &_name,					\
+}
+
+#define CPQ_ATTRIBUTE(_name, _mode, _type, _callback) \
+	static struct cpuquiet_attribute _name ## _attr = {		\
+		.attr = {.name = __stringify(_name), .mode = _mode },	\
+		.show = show_ ## _type ## _attribute,			\
+		.store = store_ ## _type ## _attribute,			\
+		.param = &_name,					\
+		.store_callback = _callback,				\
+}
+
+extern ssize_t show_int_attribute(struct cpuquiet_attribute *cattr, char *buf);
+extern ssize_t store_int_attribute(struct cpuquiet_attribute *cattr,
+					const char *buf, size_t count);
+extern ssize_t show_bool_attribute(struct cpuquiet_attribute *cattr,
+					char *buf);
+extern ssize_t store_bool_attribute(struct cpuquiet_attribute *cattr,
+					const char *buf, size_t count);
+extern ssize_t store_uint_attribute(struct cpuquiet_attribute *cattr,
+					const char *buf, size_t count);
+extern ssize_t show_uint_attribute(struct cpuquiet_attribute *cattr,
+					char *buf);
+extern ssize_t store_ulong_attribute(struct cpuquiet_attribute *cattr,
+					const char *buf, size_t count);
+extern ssize_t show_ulong_attribute(struct cpuquiet_attribute *cattr,
+					char *buf);
+extern ssize_t cpuquiet_auto_sysfs_show(struct kobject *kobj,
+					struct attribute *attr, char *buf);
+extern ssize_t cpuquiet_auto_sysfs_store(struct kobject *kobj,
+					struct attribute *attr, const char *buf,
+					size_t count);
+
+#endif
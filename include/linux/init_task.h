@@ -135,6 +135,13 @@ extern struct task_group root_task_group;
 # define INIT_PERF_EVENTS(tsk)
 #endif
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+# define INIT_LOWMEM_ENTRY(tsk)						\
+	.lowmem_entry = LIST_HEAD_INIT(tsk.lowmem_entry),
+#else
+# define INIT_LOWMEM_ENTRY(tsk)
+#endif
+
 /*
  *  INIT_TASK is used to set up the first task table, touch at
  * your own risk!. Base=0, limit=0x1fffff (=2MB)
@@ -194,6 +201,7 @@ extern struct task_group root_task_group;
 		[PIDTYPE_SID]  = INIT_PID_LINK(PIDTYPE_SID),		\
 	},								\
 	.thread_group	= LIST_HEAD_INIT(tsk.thread_group),		\
+	INIT_LOWMEM_ENTRY(tsk)						\
 	.dirties = INIT_PROP_LOCAL_SINGLE(dirties),			\
 	INIT_IDS							\
 	INIT_PERF_EVENTS(tsk)						\
@@ -39,12 +39,12 @@ extern void rcu_barrier(void);
 #define rcu_barrier_bh                         rcu_barrier
 
 extern void synchronize_sched(void);
+extern void synchronize_sched_expedited(void);
 
 #define synchronize_rcu                        synchronize_sched
 #define synchronize_rcu_bh                     synchronize_sched
-#define synchronize_rcu_expedited              synchronize_sched
-#define synchronize_rcu_bh_expedited           synchronize_sched
-#define synchronize_sched_expedited            synchronize_sched
+#define synchronize_rcu_expedited              synchronize_sched_expedited
+#define synchronize_rcu_bh_expedited           synchronize_sched_expedited
 
 #define rcu_init(cpu)                          do { } while (0)
 #define rcu_init_sched()                       do { } while (0)
@@ -200,6 +200,23 @@ struct nvhost_ctrl_syncpt_waitex_args {
 	__u32 value;
 };
 
+struct nvhost_ctrl_sync_fence_info {
+	__u32 id;
+	__u32 thresh;
+};
+
+struct nvhost_ctrl_sync_fence_create_args {
+	__u64 pts;		/* struct nvhost_ctrl_sync_fence_info * */
+	__u32 num_pts;
+	__s32 fence_fd;		/* Return value */
+};
+
+struct nvhost_ctrl_sync_fence_merge_args {
+	__s32 fd1;
+	__s32 fd2;
+	__s32 fence_fd;		/* Return value */
+};
+
 struct nvhost_ctrl_module_mutex_args {
 	__u32 id;
 	__u32 lock;
@@ -235,8 +252,13 @@ enum nvhost_module_id {
 #define NVHOST_IOCTL_CTRL_SYNCPT_READ_MAX	\
 	_IOWR(NVHOST_IOCTL_MAGIC, 8, struct nvhost_ctrl_syncpt_read_args)
 
+#define NVHOST_IOCTL_CTRL_SYNC_FENCE_CREATE	\
+	_IOWR(NVHOST_IOCTL_MAGIC, 9, struct nvhost_ctrl_sync_fence_create_args)
+#define NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE	\
+	_IOWR(NVHOST_IOCTL_MAGIC, 10, struct nvhost_ctrl_sync_fence_merge_args)
+
 #define NVHOST_IOCTL_CTRL_LAST			\
-	_IOC_NR(NVHOST_IOCTL_CTRL_SYNCPT_READ_MAX)
+	_IOC_NR(NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE)
 #define NVHOST_IOCTL_CTRL_MAX_ARG_SIZE	\
 	sizeof(struct nvhost_ctrl_module_regrdwr_args)
 
@@ -52,6 +52,10 @@ extern void out_of_memory(struct zonelist *zonelist, gfp_t gfp_mask,
 extern int register_oom_notifier(struct notifier_block *nb);
 extern int unregister_oom_notifier(struct notifier_block *nb);
 
+extern int oom_adj_register(struct notifier_block *nb);
+extern int oom_adj_unregister(struct notifier_block *nb);
+extern void oom_adj_notify(struct task_struct *p);
+
 extern bool oom_killer_disabled;
 
 static inline void oom_killer_disable(void)
@@ -147,6 +147,10 @@ extern unsigned long this_cpu_load(void);
 #ifdef CONFIG_TDF_RQ_STATS
 extern void sched_update_nr_prod(int cpu, unsigned long nr, bool inc);
 extern void sched_get_nr_running_avg(int *avg);
+extern void sched_get_nr_running_avg_iowait(int *avg, int *iowait_avg);
+extern void sched_get_nr_running_ewma(unsigned int *avg,
+				      unsigned int *iowait_avg);
+extern void sched_set_nr_run_trigger(unsigned int level, void (*fn)(u64 time));
 #endif
 
 extern void calc_global_load(unsigned long ticks);
@@ -522,6 +526,18 @@ struct thread_group_cputimer {
 #include <linux/rwsem.h>
 struct autogroup;
 
+/*
+ * Memory a process holds through drivers rather than through its page
+ * tables.  The drivers charge and uncharge it as they go, so it can be
+ * read from /proc/<pid>/drvmem without walking their data structures.
+ */
+enum drvmem_item {
+	DRVMEM_ASHMEM,
+	DRVMEM_BINDER,
+	DRVMEM_NVMAP,
+	NR_DRVMEM_ITEMS
+};
+
 /*
  * NOTE! "signal_struct" does not have its own
  * locking, because a shared signal_struct always
@@ -609,6 +625,7 @@ struct signal_struct {
 	unsigned long inblock, oublock, cinblock, coublock;
 	unsigned long maxrss, cmaxrss;
 	struct task_io_accounting ioac;
+	atomic_long_t drvmem[NR_DRVMEM_ITEMS];	/* bytes, see enum drvmem_item */
 
 	/*
 	 * Cumulative ns of schedule CPU time fo dead threads in the
@@ -1351,6 +1368,9 @@ struct task_struct {
 	/* PID/PID hash table linkage. */
 	struct pid_link pids[PIDTYPE_MAX];
 	struct list_head thread_group;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct list_head lowmem_entry;	/* lowmemorykiller's oom_adj index */
+#endif
 
 	struct completion *vfork_done;		/* for vfork() */
 	int __user *set_child_tid;		/* CLONE_CHILD_SETTID */
@@ -2724,6 +2744,21 @@ static inline unsigned long task_rlimit_max(const struct task_struct *tsk,
 	return ACCESS_ONCE(tsk->signal->rlim[limit].rlim_max);
 }
 
+/* charge (or, with negative bytes, uncharge) tsk's process */
+static inline void task_drvmem_add(struct task_struct *tsk,
+				   enum drvmem_item item, long bytes)
+{
+	atomic_long_add(bytes, &tsk->signal->drvmem[item]);
+}
+
+static inline unsigned long task_drvmem(struct task_struct *tsk,
+					enum drvmem_item item)
+{
+	long bytes = atomic_long_read(&tsk->signal->drvmem[item]);
+
+	return bytes > 0 ? bytes : 0;
+}
+
 static inline unsigned long rlimit(unsigned int limit)
 {
 	return task_rlimit(current, limit);
@@ -0,0 +1,34 @@
+#ifndef _LINUX_VMPRESSURE_H
+#define _LINUX_VMPRESSURE_H
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+
+/*
+ * How hard reclaim has to work to free memory. Low means most of the
+ * scanned pages were reclaimed, critical means reclaim is thrashing.
+ */
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+#ifdef CONFIG_VMPRESSURE
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+extern enum vmpressure_levels vmpressure_level(void);
+#else
+static inline void vmpressure(gfp_t gfp, unsigned long scanned,
+			      unsigned long reclaimed)
+{
+}
+
+static inline enum vmpressure_levels vmpressure_level(void)
+{
+	return VMPRESSURE_LOW;
+}
+#endif /* CONFIG_VMPRESSURE */
+
+#endif /* _LINUX_VMPRESSURE_H */
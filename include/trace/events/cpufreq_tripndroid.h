@@ -0,0 +1,100 @@
+/*
+ * include/trace/events/cpufreq_tripndroid.h
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_tripndroid
+
+#if !defined(_TRACE_CPUFREQ_TRIPNDROID_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_TRIPNDROID_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * which path took the decision: the sample timer, the scheduler hook or
+ * a task group frequency floor
+ */
+#define TRIPNDROID_MODE_TIMER	0
+#define TRIPNDROID_MODE_SCHED	1
+#define TRIPNDROID_MODE_BOOST	2
+
+#define show_tripndroid_mode(mode)					\
+	__print_symbolic(mode,						\
+		{ TRIPNDROID_MODE_TIMER,	"timer" },		\
+		{ TRIPNDROID_MODE_SCHED,	"sched" },		\
+		{ TRIPNDROID_MODE_BOOST,	"boost" })
+
+TRACE_EVENT(cpufreq_tripndroid_target,
+	TP_PROTO(unsigned int cpu, unsigned int load, unsigned int curtarg,
+		 unsigned int newtarg, int mode),
+
+	TP_ARGS(cpu, load, curtarg, newtarg, mode),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu)
+		__field(unsigned int, load)
+		__field(unsigned int, curtarg)
+		__field(unsigned int, newtarg)
+		__field(int, mode)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->load = load;
+		__entry->curtarg = curtarg;
+		__entry->newtarg = newtarg;
+		__entry->mode = mode;
+	),
+
+	TP_printk("cpu=%u load=%u cur=%u targ=%u mode=%s",
+		__entry->cpu, __entry->load, __entry->curtarg,
+		__entry->newtarg,
+		show_tripndroid_mode(__entry->mode))
+);
+
+TRACE_EVENT(cpufreq_tripndroid_setspeed,
+	TP_PROTO(unsigned int cpu, unsigned int freq, int mode,
+		 unsigned long latency_us),
+
+	TP_ARGS(cpu, freq, mode, latency_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu)
+		__field(unsigned int, freq)
+		__field(int, mode)
+		__field(unsigned long, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->freq = freq;
+		__entry->mode = mode;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("cpu=%u freq=%u mode=%s latency=%luus",
+		__entry->cpu, __entry->freq,
+		show_tripndroid_mode(__entry->mode),
+		__entry->latency_us)
+);
+
+#endif /* _TRACE_CPUFREQ_TRIPNDROID_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -72,6 +72,9 @@
 #include <linux/compiler.h>
 #include <linux/irqflags.h>
 #include <linux/rcupdate.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/spinlock.h>
 
 #include <asm/system.h>
 
@@ -136,6 +139,7 @@ struct rcu_data {
                                 * the retirement of the current batch */
        struct rcu_list cblist[2]; /* current & previous callback lists */
        s64 nqueued;            /* #callbacks queued (stats-n-debug) */
+       int npeak;              /* longest queue seen (stats-n-debug) */
 } ____cacheline_aligned_in_smp;
 
 static struct rcu_data rcu_data[NR_CPUS];
@@ -148,8 +152,11 @@ static struct rcu_stats {
        unsigned nmis;          /* #passes discarded due to NMI */
        atomic_t nbarriers;     /* #rcu barriers processed */
        atomic_t nsyncs;        /* #rcu syncs processed */
-       s64 ninvoked;           /* #invoked (ie, finished) callbacks */
+       atomic_t nexpsyncs;     /* #expedited rcu syncs processed */
+       atomic64_t ninvoked;    /* #invoked (ie, finished) callbacks */
        unsigned nforced;       /* #forced eobs (should be zero) */
+       unsigned nexpedited;    /* #passes made by expedited syncs */
+       unsigned nflood;        /* #passes made in callback flood mode */
 } rcu_stats;
 
 #define RCU_HZ                 (20)
@@ -167,6 +174,60 @@ int rcu_nmi_seen __read_mostly;
 static int rcu_wdog_ctr;       /* time since last end-of-batch, in usecs */
 static int rcu_wdog_lim = 10 * USEC_PER_SEC;   /* rcu watchdog interval */
 
+/*
+ * Shortest time we allow between two end-of-batches, unless every cpu
+ * has been through an IPI since the last one (expedited syncs).
+ */
+#define RCU_MIN_FRAME_US       (100)
+
+static ktime_t rcu_last_eob;
+
+/* serializes the daemon (or timer) with expedited syncs */
+static DEFINE_RAW_SPINLOCK(rcu_delimit_lock);
+
+/*
+ * Callback flood mode: once some cpu has more than rcu_flood_lim
+ * callbacks queued, run frames every rcu_flood_period_us instead of
+ * every rcu_hz_period_us until the queues have drained.
+ */
+#define RCU_FLOOD_HZ           (200)
+
+static int rcu_flood_lim = 1000;       /* 0 disables flood mode */
+static int rcu_flood_period_us = USEC_PER_SEC / RCU_FLOOD_HZ;
+static int rcu_flooding;
+
+static inline int rcu_frame_us(void)
+{
+       if (rcu_flooding && rcu_flood_period_us < rcu_hz_period_us)
+               return rcu_flood_period_us;
+       return rcu_hz_period_us;
+}
+
+/* grace period latency histogram, upper bounds in usecs */
+static const unsigned int rcu_gp_bounds[] = {
+       1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, UINT_MAX
+};
+
+enum {
+       RCU_GP_NORMAL = 0,
+       RCU_GP_EXPEDITED,
+       RCU_GP_MAX,
+};
+
+static atomic_t rcu_gp_hist[RCU_GP_MAX][ARRAY_SIZE(rcu_gp_bounds)];
+
+static void rcu_gp_record(int type, ktime_t start)
+{
+       s64 delta = ktime_us_delta(ktime_get(), start);
+       int i;
+
+       for (i = 0; i < ARRAY_SIZE(rcu_gp_bounds) - 1; i++)
+               if (delta < rcu_gp_bounds[i])
+                       break;
+
+       atomic_inc(&rcu_gp_hist[type][i]);
+}
+
 /*
  * Return our CPU id or zero if we are too early in the boot process to
  * know what that is.  For RCU to work correctly, a cpu named '0' must
@@ -235,15 +296,17 @@ EXPORT_SYMBOL(rcu_note_might_resched);
 void synchronize_sched(void)
 {
        struct rcu_synchronize rcu;
+       ktime_t start;
 
        if (!rcu_scheduler_active)
                return;
 
+       start = ktime_get();
        init_completion(&rcu.completion);
        call_rcu(&rcu.head, wakeme_after_rcu);
        wait_for_completion(&rcu.completion);
        atomic_inc(&rcu_stats.nsyncs);
-
+       rcu_gp_record(RCU_GP_NORMAL, start);
 }
 EXPORT_SYMBOL_GPL(synchronize_sched);
 
@@ -297,6 +360,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
 static void rcu_invoke_callbacks(struct rcu_list *pending)
 {
        struct rcu_head *curr, *next;
+       int n = 0;
 
        for (curr = pending->head; curr;) {
                unsigned long offset = (unsigned long)curr->func;
@@ -306,8 +370,10 @@ static void rcu_invoke_callbacks(struct rcu_list *pending)
                else
                        curr->func(curr);
                curr = next;
-               rcu_stats.ninvoked++;
+               n++;
        }
+       /* expedited syncs may invoke callbacks alongside the daemon */
+       atomic64_add(n, &rcu_stats.ninvoked);
 }
 
 /*
@@ -321,15 +387,19 @@ static void rcu_invoke_callbacks(struct rcu_list *pending)
  *
  * "Quiescent" means the owning cpu is no longer appending callbacks
  * and has completed execution of a trailing write-memory-barrier insn.
+ * A caller that has just made every cpu take an IPI knows that to be
+ * true already and passes @quiesced.
+ *
+ * Returns nonzero if the current batch was ended.
  */
-static void __rcu_delimit_batches(struct rcu_list *pending)
+static int __rcu_delimit_batches(struct rcu_list *pending, int quiesced)
 {
        struct rcu_data *rd;
        struct rcu_list *plist;
        int cpu, eob, prev;
 
        if (!rcu_scheduler_active)
-               return;
+               return 0;
 
        rcu_stats.nlast++;
 
@@ -339,9 +409,14 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
        if (rcu_nmi_seen) {
                rcu_nmi_seen = 0;
                rcu_stats.nmis++;
-               return;
+               return 0;
        }
 
+       /* An expedited sync may have ended a batch just now. */
+       if (!quiesced &&
+           ktime_us_delta(ktime_get(), rcu_last_eob) < RCU_MIN_FRAME_US)
+               return 0;
+
        /*
         * Find out if the current batch has ended
         * (end-of-batch).
@@ -371,8 +446,8 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
                                        force_cpu_resched(cpu);
                        }
                }
-               rcu_wdog_ctr += rcu_hz_period_us;
-               return;
+               rcu_wdog_ctr += rcu_frame_us();
+               return 0;
        }
 
        /*
@@ -416,25 +491,157 @@ static void __rcu_delimit_batches(struct rcu_list *pending)
        rcu_stats.nbatches++;
        rcu_stats.nlast = 0;
        rcu_wdog_ctr = 0;
+       rcu_last_eob = ktime_get();
+       return 1;
 }
 
-static void rcu_delimit_batches(void)
+/*
+ * Enter or leave callback flood mode depending on the longest per-cpu
+ * callback queue.  Called with rcu_delimit_lock held.
+ */
+static int rcu_check_flood(void)
+{
+       struct rcu_data *rd;
+       int cpu, len, maxlen = 0;
+
+       for_each_online_cpu(cpu) {
+               rd = &rcu_data[cpu];
+               len = ACCESS_ONCE(rd->cblist[0].count) +
+                       ACCESS_ONCE(rd->cblist[1].count);
+               if (len > rd->npeak)
+                       rd->npeak = len;
+               if (len > maxlen)
+                       maxlen = len;
+       }
+
+       rcu_flooding = rcu_flood_lim && maxlen >= rcu_flood_lim;
+       if (rcu_flooding)
+               rcu_stats.nflood++;
+       return rcu_flooding;
+}
+
+#ifdef CONFIG_JRCU_LAZY
+/*
+ * Lazy cpus do not order their end-of-batch consent with a barrier, so
+ * the daemon may not see it for a frame or two.  When flooded, don't
+ * wait for that: the IPI makes every cpu's ->wait store visible.
+ */
+static void rcu_lazy_ipi(void *unused)
+{
+       smp_mb();
+}
+
+static void rcu_flood_kick(void)
+{
+       /* smp_call_function() must not be used from softirq (timer mode) */
+       if (!in_interrupt())
+               smp_call_function(rcu_lazy_ipi, NULL, 0);
+}
+#else
+static inline void rcu_flood_kick(void)
+{
+}
+#endif
+
+/*
+ * One pass of the batch machinery.  @expedited passes come from
+ * synchronize_sched_expedited(), which has IPI'd every cpu after it saw
+ * end-of-batch number @seq; they are discarded if another end-of-batch
+ * happened meanwhile.
+ */
+static int do_rcu_delimit_batches(int expedited, unsigned seq)
 {
        unsigned long flags;
        struct rcu_list pending;
+       int eob = 0, flood;
 
        rcu_list_init(&pending);
-       rcu_stats.npasses++;
 
-       raw_local_irq_save(flags);
+       raw_spin_lock_irqsave(&rcu_delimit_lock, flags);
        smp_mb();
-       __rcu_delimit_batches(&pending);
+       rcu_stats.npasses++;
+       if (!expedited)
+               eob = __rcu_delimit_batches(&pending, 0);
+       else {
+               rcu_stats.nexpedited++;
+               if (seq == rcu_stats.nbatches)
+                       eob = __rcu_delimit_batches(&pending, 1);
+       }
+       flood = rcu_check_flood();
        smp_mb();
-       raw_local_irq_restore(flags);
+       raw_spin_unlock_irqrestore(&rcu_delimit_lock, flags);
 
        if (pending.head)
                rcu_invoke_callbacks(&pending);
+
+       if (flood && !eob && !expedited)
+               rcu_flood_kick();
+
+       return eob;
+}
+
+static void rcu_delimit_batches(void)
+{
+       do_rcu_delimit_batches(0, 0);
+}
+
+/* ------------------ expedited grace periods ------------------- */
+
+#define RCU_EXPEDITE_TRIES     (100)
+
+/*
+ * Sent to every other cpu by synchronize_sched_expedited().  Taking the
+ * IPI is itself enough to make the cpu quiescent with respect to the
+ * last end-of-batch.  A cpu that still holds up the current batch gets
+ * pushed through the scheduler as soon as it leaves its read-side
+ * section.
+ */
+static void rcu_expedite_ipi(void *unused)
+{
+       int cpu = smp_processor_id();
+
+       if (rcu_data[cpu].wait && !idle_cpu(cpu))
+               set_need_resched();
+}
+
+/*
+ * Like synchronize_sched(), but instead of waiting for the daemon's
+ * frames, drive the batches from here, IPI'ing all cpus before each
+ * pass.  Falls back to waiting on the daemon if some cpu refuses to
+ * become quiescent for a long time.
+ */
+void synchronize_sched_expedited(void)
+{
+       struct rcu_synchronize rcu;
+       ktime_t start;
+       unsigned seq;
+       int tries;
+
+       if (!rcu_scheduler_active)
+               return;
+
+       start = ktime_get();
+       init_completion(&rcu.completion);
+       call_rcu(&rcu.head, wakeme_after_rcu);
+
+       for (tries = 0; tries < RCU_EXPEDITE_TRIES; tries++) {
+               seq = ACCESS_ONCE(rcu_stats.nbatches);
+               smp_mb();
+               smp_call_function(rcu_expedite_ipi, NULL, 1);
+               rcu_note_might_resched();
+
+               if (!do_rcu_delimit_batches(1, seq))
+                       usleep_range(RCU_MIN_FRAME_US, 2 * RCU_MIN_FRAME_US);
+
+               if (completion_done(&rcu.completion))
+                       break;
+       }
+
+       wait_for_completion(&rcu.completion);
+       atomic_inc(&rcu_stats.nexpsyncs);
+       rcu_gp_record(RCU_GP_EXPEDITED, start);
 }
+EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
 
 /* ------------------ interrupt driver section ------------------ */
 
@@ -448,7 +655,7 @@ static void rcu_delimit_batches(void)
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 
-#define rcu_hz_period_ns       (rcu_hz_period_us * NSEC_PER_USEC)
+#define rcu_hz_period_ns       (rcu_frame_us() * NSEC_PER_USEC)
 #define rcu_hz_delta_ns                (rcu_hz_delta_us * NSEC_PER_USEC)
 
 static struct hrtimer rcu_timer;
@@ -550,12 +757,14 @@ static int jrcud_func(void *arg)
        pr_info("JRCU: callback processing via daemon started.\n");
 
        while (!kthread_should_stop()) {
+               int period_us = rcu_frame_us();
+
                if (rcu_hz_precise) {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us);
+                       usleep_range(period_us,
+                               period_us);
                } else {
-                       usleep_range(rcu_hz_period_us,
-                               rcu_hz_period_us + rcu_hz_delta_us);
+                       usleep_range(period_us,
+                               period_us + rcu_hz_delta_us);
                }
                rcu_delimit_batches();
        }
@@ -609,6 +818,11 @@ static int rcu_debugfs_show(struct seq_file *m, void *unused)
                rcu_hz,
                rcu_hz_precise ? "precise" : "sloppy");
 
+       seq_printf(m, "%14u: flood hz, %s\n",
+               (int)USEC_PER_SEC / rcu_flood_period_us,
+               rcu_flooding ? "flooding" : "not flooding");
+       seq_printf(m, "%14u: flood threshold (0 is off)\n", rcu_flood_lim);
+
        seq_printf(m, "%14u: watchdog (secs)\n", rcu_wdog_lim / (int)USEC_PER_SEC);
        seq_printf(m, "%14d: #secs left on watchdog\n",
                (rcu_wdog_lim - rcu_wdog_ctr) / (int)USEC_PER_SEC);
@@ -633,16 +847,22 @@ static int rcu_debugfs_show(struct seq_file *m, void *unused)
                rcu_stats.nlast);
        seq_printf(m, "%14u: #passes forced (0 is best)\n",
                rcu_stats.nforced);
+       seq_printf(m, "%14u: #passes made by expedited syncs\n",
+               rcu_stats.nexpedited);
+       seq_printf(m, "%14u: #passes made in flood mode\n",
+               rcu_stats.nflood);
 
        seq_printf(m, "\n");
        seq_printf(m, "%14u: #barriers\n",
                atomic_read(&rcu_stats.nbarriers));
        seq_printf(m, "%14u: #syncs\n",
                atomic_read(&rcu_stats.nsyncs));
+       seq_printf(m, "%14u: #expedited syncs\n",
+               atomic_read(&rcu_stats.nexpsyncs));
        seq_printf(m, "%14llu: #callbacks invoked\n",
-               rcu_stats.ninvoked);
+               (u64)atomic64_read(&rcu_stats.ninvoked));
        seq_printf(m, "%14d: #callbacks left to invoke\n",
-               (int)(nqueued - rcu_stats.ninvoked));
+               (int)(nqueued - atomic64_read(&rcu_stats.ninvoked)));
        seq_printf(m, "\n");
 
        for_each_online_cpu(cpu)
@@ -721,6 +941,18 @@ next:
                rcu_hz_period_us = USEC_PER_SEC / rcu_hz;
        } else if (!strncmp(token, "precise=", 8)) {
                sscanf(&token[8], "%d", &rcu_hz_precise);
+       } else if (!strncmp(token, "floodhz=", 8)) {
+               int flood_hz = -1;
+               sscanf(&token[8], "%d", &flood_hz);
+               if (flood_hz < 2 || flood_hz > 1000)
+                       return -EINVAL;
+               rcu_flood_period_us = USEC_PER_SEC / flood_hz;
+       } else if (!strncmp(token, "flood=", 6)) {
+               int flood = -1;
+               sscanf(&token[6], "%d", &flood);
+               if (flood < 0)
+                       return -EINVAL;
+               rcu_flood_lim = flood;
        } else if (!strncmp(token, "wdog=", 5)) {
                int wdog = -1;
                sscanf(&token[5], "%d", &wdog);
@@ -746,6 +978,50 @@ static const struct file_operations rcu_debugfs_fops = {
        .release = single_release,
 };
 
+/*
+ * Per-cpu callback queue lengths and the synchronize_sched() and
+ * synchronize_sched_expedited() latency histograms.
+ */
+static int rcu_gp_debugfs_show(struct seq_file *m, void *unused)
+{
+       int cpu, i, w = ACCESS_ONCE(rcu_which);
+
+       seq_printf(m, "%4s %10s %10s %10s %14s\n",
+               "CPU", "current", "previous", "peak", "queued");
+       for_each_present_cpu(cpu) {
+               struct rcu_data *rd = &rcu_data[cpu];
+               seq_printf(m, "%4d %10d %10d %10d %14lld\n", cpu,
+                       rd->cblist[w].count, rd->cblist[w ^ 1].count,
+                       rd->npeak, rd->nqueued);
+       }
+
+       seq_printf(m, "\n%-10s %10s %10s\n", "usecs", "normal", "expedited");
+       for (i = 0; i < ARRAY_SIZE(rcu_gp_bounds); i++) {
+               if (rcu_gp_bounds[i] == UINT_MAX)
+                       seq_printf(m, "%-10s ", "inf");
+               else
+                       seq_printf(m, "%-10u ", rcu_gp_bounds[i]);
+               seq_printf(m, "%10u %10u\n",
+                       atomic_read(&rcu_gp_hist[RCU_GP_NORMAL][i]),
+                       atomic_read(&rcu_gp_hist[RCU_GP_EXPEDITED][i]));
+       }
+
+       return 0;
+}
+
+static int rcu_gp_debugfs_open(struct inode *inode, struct file *file)
+{
+       return single_open(file, rcu_gp_debugfs_show, NULL);
+}
+
+static const struct file_operations rcu_gp_debugfs_fops = {
+       .owner = THIS_MODULE,
+       .open = rcu_gp_debugfs_open,
+       .read = seq_read,
+       .llseek = seq_lseek,
+       .release = single_release,
+};
+
 static struct dentry *rcudir;
 
 static int __init rcu_debugfs_init(void)
@@ -761,6 +1037,11 @@ static int __init rcu_debugfs_init(void)
        if (!retval)
                goto error;
 
+       retval = debugfs_create_file("rcugp", 0444, rcudir,
+                       NULL, &rcu_gp_debugfs_fops);
+       if (!retval)
+               goto error;
+
        return 0;
 
 error:
@@ -72,6 +72,8 @@
 #include <linux/ftrace.h>
 #include <linux/slab.h>
 #include <linux/cpuacct.h>
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -269,6 +271,13 @@ struct task_group {
 	struct rt_bandwidth rt_bandwidth;
 #endif
 
+#ifdef CONFIG_CGROUP_FREQ_BOOST
+	/* frequency floor in kHz while a task of the group runs, 0 = off */
+	unsigned int freq_boost_min;
+	/* how long the floor lasts after switch in, 0 = while running */
+	unsigned int freq_boost_ms;
+#endif
+
 	struct rcu_head rcu;
 	struct list_head list;
 
@@ -3086,6 +3095,119 @@ fire_sched_out_preempt_notifiers(struct task_struct *curr,
 
 #endif /* CONFIG_PREEMPT_NOTIFIERS */
 
+#ifdef CONFIG_CGROUP_FREQ_BOOST
+/*
+ * Per-cpu frequency floor of the task group currently running. Written
+ * at context switch with the rq lock held and irqs off (ahead of
+ * prepare_lock_switch()), read locklessly by the cpufreq governors
+ * through cpufreq_boost_floor().
+ */
+struct freq_boost {
+	unsigned int floor;
+	unsigned long expires;		/* jiffies, 0 = no expiry */
+	struct irq_work work;
+};
+
+static DEFINE_PER_CPU(struct freq_boost, freq_boost);
+static void (*cpufreq_boost_hook)(int cpu, unsigned int floor);
+
+unsigned int cpufreq_boost_floor(int cpu)
+{
+	struct freq_boost *fb = &per_cpu(freq_boost, cpu);
+	unsigned int floor;
+	unsigned long expires;
+
+	floor = ACCESS_ONCE(fb->floor);
+	smp_rmb();
+	expires = ACCESS_ONCE(fb->expires);
+
+	if (floor && expires && time_after_eq(jiffies, expires))
+		return 0;
+
+	return floor;
+}
+EXPORT_SYMBOL_GPL(cpufreq_boost_floor);
+
+void cpufreq_boost_set_hook(void (*hook)(int cpu, unsigned int floor))
+{
+	ACCESS_ONCE(cpufreq_boost_hook) = hook;
+}
+EXPORT_SYMBOL_GPL(cpufreq_boost_set_hook);
+
+/*
+ * Clear the hook only if it is still @hook, so that a governor stopping
+ * does not unhook another governor that installed its own since.
+ */
+void cpufreq_boost_clear_hook(void (*hook)(int cpu, unsigned int floor))
+{
+	int cpu;
+
+	if (cmpxchg(&cpufreq_boost_hook, hook, NULL) != hook)
+		return;
+
+	/* wait for context switches and queued work that saw the old hook */
+	synchronize_sched();
+	for_each_possible_cpu(cpu)
+		irq_work_sync(&per_cpu(freq_boost, cpu).work);
+}
+EXPORT_SYMBOL_GPL(cpufreq_boost_clear_hook);
+
+/*
+ * Runs on the cpu that raised its floor, out of the rq lock, so the
+ * governor is free to wake up its speed change thread.
+ */
+static void freq_boost_kick(struct irq_work *work)
+{
+	void (*hook)(int cpu, unsigned int floor);
+	int cpu = smp_processor_id();
+	unsigned int floor;
+
+	hook = ACCESS_ONCE(cpufreq_boost_hook);
+	floor = cpufreq_boost_floor(cpu);
+	if (hook && floor)
+		hook(cpu, floor);
+}
+
+static void __init freq_boost_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		init_irq_work(&per_cpu(freq_boost, cpu).work, freq_boost_kick);
+}
+
+static inline void
+freq_boost_switch(struct rq *rq, struct task_struct *next)
+{
+	struct freq_boost *fb = &per_cpu(freq_boost, cpu_of(rq));
+	struct task_group *tg = task_group(next);
+	unsigned int old = cpufreq_boost_floor(cpu_of(rq));
+	unsigned int floor = tg->freq_boost_min;
+	unsigned int ms = tg->freq_boost_ms;
+
+	if (!floor && !fb->floor)
+		return;
+
+	/* | 1 so that a wrapped jiffies value never reads as "no expiry" */
+	fb->expires = (floor && ms) ? (jiffies + msecs_to_jiffies(ms)) | 1 : 0;
+	smp_wmb();
+	fb->floor = floor;
+
+	/* going down is left to the governor's own sampling */
+	if (floor > old && ACCESS_ONCE(cpufreq_boost_hook))
+		irq_work_queue(&fb->work);
+}
+#else
+static inline void freq_boost_init(void)
+{
+}
+
+static inline void
+freq_boost_switch(struct rq *rq, struct task_struct *next)
+{
+}
+#endif /* CONFIG_CGROUP_FREQ_BOOST */
+
 /**
  * prepare_task_switch - prepare to switch tasks
  * @rq: the runqueue preparing to switch
@@ -3106,6 +3228,8 @@ prepare_task_switch(struct rq *rq, struct task_struct *prev,
 	sched_info_switch(prev, next);
 	perf_event_task_sched_out(prev, next);
 	fire_sched_out_preempt_notifiers(prev, next);
+	/* before prepare_lock_switch(): it may drop the rq lock and enable irqs */
+	freq_boost_switch(rq, next);
 	prepare_lock_switch(rq, next);
 	prepare_arch_switch(next);
 	trace_sched_switch(prev, next);
@@ -8315,6 +8439,8 @@ void __init sched_init(void)
 		zalloc_cpumask_var(&cpu_isolated_map, GFP_NOWAIT);
 #endif /* SMP */
 
+	freq_boost_init();
+
 	scheduler_running = 1;
 }
 
@@ -9186,6 +9312,43 @@ static u64 cpu_rt_period_read_uint(struct cgroup *cgrp, struct cftype *cft)
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_CGROUP_FREQ_BOOST
+static int cpu_freq_boost_min_write(struct cgroup *cgrp, struct cftype *cft,
+				    u64 khz)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	/* boosting the root group would boost everything */
+	if (tg == &root_task_group || khz > UINT_MAX)
+		return -EINVAL;
+
+	tg->freq_boost_min = khz;
+	return 0;
+}
+
+static u64 cpu_freq_boost_min_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->freq_boost_min;
+}
+
+static int cpu_freq_boost_ms_write(struct cgroup *cgrp, struct cftype *cft,
+				   u64 ms)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	if (tg == &root_task_group || ms > UINT_MAX)
+		return -EINVAL;
+
+	tg->freq_boost_ms = ms;
+	return 0;
+}
+
+static u64 cpu_freq_boost_ms_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->freq_boost_ms;
+}
+#endif /* CONFIG_CGROUP_FREQ_BOOST */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -9206,6 +9369,18 @@ static struct cftype cpu_files[] = {
 		.write_u64 = cpu_rt_period_write_uint,
 	},
 #endif
+#ifdef CONFIG_CGROUP_FREQ_BOOST
+	{
+		.name = "freq_boost_min",
+		.read_u64 = cpu_freq_boost_min_read,
+		.write_u64 = cpu_freq_boost_min_write,
+	},
+	{
+		.name = "freq_boost_ms",
+		.read_u64 = cpu_freq_boost_ms_read,
+		.write_u64 = cpu_freq_boost_ms_write,
+	},
+#endif
 };
 
 static int cpu_cgroup_populate(struct cgroup_subsys *ss, struct cgroup *cont)
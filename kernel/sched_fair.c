@@ -23,6 +23,7 @@
 #include <linux/latencytop.h>
 #include <linux/sched.h>
 #include <linux/cpumask.h>
+#include <linux/cpufreq.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -1297,6 +1298,32 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+static void (*cpufreq_sched_hook)(int cpu, unsigned long nr_running);
+
+void cpufreq_sched_set_hook(void (*hook)(int cpu, unsigned long nr_running))
+{
+	ACCESS_ONCE(cpufreq_sched_hook) = hook;
+	/* hook callers run with the rq lock held and irqs disabled */
+	if (!hook)
+		synchronize_sched();
+}
+EXPORT_SYMBOL_GPL(cpufreq_sched_set_hook);
+
+static inline void cpufreq_sched_notify(struct rq *rq, unsigned long nr_running)
+{
+	void (*hook)(int cpu, unsigned long nr_running);
+
+	hook = ACCESS_ONCE(cpufreq_sched_hook);
+	if (hook)
+		hook(cpu_of(rq), nr_running);
+}
+#else
+static inline void cpufreq_sched_notify(struct rq *rq, unsigned long nr_running)
+{
+}
+#endif
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -1308,6 +1335,9 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	if (flags & ENQUEUE_WAKEUP)
+		cpufreq_sched_notify(rq, rq->nr_running + 1);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -4177,6 +4207,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	cpufreq_sched_notify(rq, rq->nr_running);
 }
 
 /*
@@ -0,0 +1,149 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Implements the LZ4 block format by Yann Collet, see
+ *  http://code.google.com/p/lz4/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Length of the common prefix of @ip and @ref, up to @limit */
+static inline size_t lz4_count(const unsigned char *ip,
+		const unsigned char *ref, const unsigned char *limit)
+{
+	const unsigned char *start = ip;
+
+	while (ip < limit - (sizeof(long) - 1)) {
+		if (get_unaligned((const unsigned long *)ip) !=
+		    get_unaligned((const unsigned long *)ref))
+			break;
+		ip += sizeof(long);
+		ref += sizeof(long);
+	}
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+
+	return ip - start;
+}
+
+static inline unsigned char *lz4_put_len(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	const unsigned char *ip = src, *anchor = src, *ref;
+	unsigned char * const oend = dst + *dst_len;
+	unsigned char *op = dst, *token;
+	u32 *hash_table = wrkmem;
+	size_t lit_len, match_len;
+	u32 seq, h;
+
+	memset(hash_table, 0, LZ4_MEM_COMPRESS);
+
+	/* too short for any match, everything is a literal */
+	if (src_len <= MFLIMIT)
+		goto last_literals;
+
+	while (ip <= mflimit) {
+		seq = get_unaligned_le32(ip);
+		h = lz4_hash(seq);
+		ref = src + hash_table[h];
+		hash_table[h] = ip - src;
+
+		if (ref >= ip || ip - ref > MAX_DISTANCE ||
+		    get_unaligned_le32(ref) != seq) {
+			ip += 1 + ((ip - anchor) >> SKIP_STRENGTH);
+			continue;
+		}
+
+		/* extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		lit_len = ip - anchor;
+		match_len = lz4_count(ip + MINMATCH, ref + MINMATCH,
+				matchlimit);
+
+		if (op + 1 + lit_len / 255 + 1 + lit_len + 2 +
+		    match_len / 255 + 1 > oend)
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		token = op++;
+		if (lit_len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_put_len(op, lit_len - RUN_MASK);
+		} else {
+			*token = lit_len << ML_BITS;
+		}
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		if (match_len >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_len(op, match_len - ML_MASK);
+		} else {
+			*token |= match_len;
+		}
+
+		ip += MINMATCH + match_len;
+		anchor = ip;
+
+		/* seed the table from inside the match for the next one */
+		if (ip <= mflimit) {
+			h = lz4_hash(get_unaligned_le32(ip - 2));
+			hash_table[h] = ip - 2 - src;
+		}
+	}
+
+last_literals:
+	lit_len = iend - anchor;
+	if (op + 1 + lit_len / 255 + 1 + lit_len > oend)
+		return LZ4_E_OUTPUT_OVERRUN;
+
+	if (lit_len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_len(op, lit_len - RUN_MASK);
+	} else {
+		*op++ = lit_len << ML_BITS;
+	}
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
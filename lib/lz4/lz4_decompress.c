@@ -0,0 +1,112 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Implements the LZ4 block format by Yann Collet, see
+ *  http://code.google.com/p/lz4/
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read a length continued in extra bytes. Returns 0 when running off
+ * the end of the input.
+ */
+static inline int lz4_get_len(const unsigned char **ip,
+		const unsigned char *iend, size_t *len)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return 0;
+		s = *(*ip)++;
+		*len += s;
+	} while (s == 255);
+
+	return 1;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const unsigned char * const iend = src + src_len;
+	const unsigned char *ip = src, *ref;
+	unsigned char * const oend = dst + *dst_len;
+	unsigned char *op = dst;
+	unsigned int token;
+	size_t len, offset;
+
+	if (unlikely(!src_len))
+		return LZ4_E_INPUT_OVERRUN;
+
+	for (;;) {
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && !lz4_get_len(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(iend - ip)))
+			return LZ4_E_INPUT_OVERRUN;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			return LZ4_E_INPUT_OVERRUN;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			return LZ4_E_LOOKBEHIND_OVERRUN;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && !lz4_get_len(&ip, iend, &len))
+			return LZ4_E_INPUT_OVERRUN;
+		len += MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			return LZ4_E_OUTPUT_OVERRUN;
+
+		/*
+		 * The match may overlap the output, which is how runs are
+		 * encoded. Copy a word at a time when the source is at
+		 * least a word behind, a byte at a time otherwise.
+		 */
+		if (offset >= sizeof(u64)) {
+			while (len >= sizeof(u64)) {
+				put_unaligned(get_unaligned((const u64 *)ref),
+					      (u64 *)op);
+				op += sizeof(u64);
+				ref += sizeof(u64);
+				len -= sizeof(u64);
+			}
+		}
+		while (len--)
+			*op++ = *ref++;
+
+		if (unlikely(ip >= iend))
+			return LZ4_E_INPUT_OVERRUN;
+	}
+
+	*dst_len = op - dst;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
@@ -0,0 +1,35 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+/*
+ * A block is a series of sequences. Each starts with a token whose
+ * high nibble is the literal count and low nibble the match length
+ * minus MINMATCH; a nibble of 15 is continued by bytes added to it
+ * until one is not 255. The literals follow, then a little endian
+ * 16 bit offset back into the output and the match length bytes.
+ * The last sequence has literals only.
+ */
+#define MINMATCH	4
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	65535
+
+/* the last match must start MFLIMIT bytes before the end */
+#define MFLIMIT		12
+/* and the last LASTLITERALS bytes are always literals */
+#define LASTLITERALS	5
+
+#define LZ4_HASH_LOG	12
+#define LZ4_HASH_SIZE	(1 << LZ4_HASH_LOG)
+
+/* step up the search stride while nothing matches */
+#define SKIP_STRENGTH	6
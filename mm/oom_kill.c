@@ -572,6 +572,26 @@ int unregister_oom_notifier(struct notifier_block *nb)
 }
 EXPORT_SYMBOL_GPL(unregister_oom_notifier);
 
+/* Notifier list called after the oom_adj of a task was changed */
+static ATOMIC_NOTIFIER_HEAD(oom_adj_notifier);
+
+int oom_adj_register(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&oom_adj_notifier, nb);
+}
+EXPORT_SYMBOL(oom_adj_register);
+
+int oom_adj_unregister(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&oom_adj_notifier, nb);
+}
+EXPORT_SYMBOL(oom_adj_unregister);
+
+void oom_adj_notify(struct task_struct *p)
+{
+	atomic_notifier_call_chain(&oom_adj_notifier, 0, p);
+}
+
 /*
  * Try to acquire the OOM killer lock for the zones in zonelist.  Returns zero
  * if a parallel OOM killing is already taking place that includes a zone in
@@ -18,6 +18,8 @@
 #include <linux/bio.h>
 #include <linux/swapops.h>
 #include <linux/writeback.h>
+#include <linux/frontswap.h>
+#include <linux/ktime.h>
 #include <asm/pgtable.h>
 
 static struct bio *get_swap_bio(gfp_t gfp_flags,
@@ -91,13 +93,33 @@ void end_swap_bio_read(struct bio *bio, int err)
  */
 int swap_writepage(struct page *page, struct writeback_control *wbc)
 {
-	struct bio *bio;
-	int ret = 0, rw = WRITE;
+	int ret = 0;
 
 	if (try_to_free_swap(page)) {
 		unlock_page(page);
 		goto out;
 	}
+	if (frontswap_put_page(page) == 0) {
+		set_page_writeback(page);
+		unlock_page(page);
+		end_page_writeback(page);
+		goto out;
+	}
+	ret = __swap_writepage(page, wbc);
+out:
+	return ret;
+}
+
+/*
+ * Write a locked swap cache page straight to its slot on the swap device,
+ * without offering it to frontswap first.  Used by swap_writepage and by
+ * frontswap backends writing their own pages back to the device.
+ */
+int __swap_writepage(struct page *page, struct writeback_control *wbc)
+{
+	struct bio *bio;
+	int ret = 0, rw = WRITE;
+
 	bio = get_swap_bio(GFP_NOIO, page, end_swap_bio_write);
 	if (bio == NULL) {
 		set_page_dirty(page);
@@ -115,14 +137,44 @@ out:
 	return ret;
 }
 
+/*
+ * Swap device reads issued while frontswap is enabled carry their start
+ * time in microseconds (truncated to a long) in bi_private, so that the
+ * swap-in latency of both paths can be compared.
+ */
+static void end_swap_bio_read_timed(struct bio *bio, int err)
+{
+	unsigned long start = (unsigned long)bio->bi_private;
+
+	frontswap_swapin_latency(0,
+		(unsigned long)ktime_to_us(ktime_get()) - start);
+	end_swap_bio_read(bio, err);
+}
+
 int swap_readpage(struct page *page)
 {
 	struct bio *bio;
+	ktime_t start = ktime_set(0, 0);
 	int ret = 0;
 
 	VM_BUG_ON(!PageLocked(page));
 	VM_BUG_ON(PageUptodate(page));
-	bio = get_swap_bio(GFP_KERNEL, page, end_swap_bio_read);
+	if (frontswap_enabled)
+		start = ktime_get();
+	if (frontswap_get_page(page) == 0) {
+		SetPageUptodate(page);
+		unlock_page(page);
+		frontswap_swapin_latency(1,
+			(unsigned long)ktime_us_delta(ktime_get(), start));
+		goto out;
+	}
+	if (frontswap_enabled) {
+		bio = get_swap_bio(GFP_KERNEL, page, end_swap_bio_read_timed);
+		if (bio)
+			bio->bi_private = (void *)(unsigned long)
+				ktime_to_us(start);
+	} else
+		bio = get_swap_bio(GFP_KERNEL, page, end_swap_bio_read);
 	if (bio == NULL) {
 		unlock_page(page);
 		ret = -ENOMEM;
@@ -0,0 +1,184 @@
+/*
+ * Memory pressure level
+ *
+ * Reclaim reports the pages it scanned and the pages it managed to
+ * reclaim. Every vmpressure_win scanned pages the ratio of the two is
+ * turned into a pressure level, which in-kernel users can query with
+ * vmpressure_level() and userspace can poll() for in
+ * /sys/kernel/mm/vmpressure/level.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+
+/*
+ * The number of scanned pages a level is computed over. Small enough to
+ * react within a few reclaim passes, large enough not to follow every
+ * single batch of SWAP_CLUSTER_MAX pages.
+ */
+static const unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/* the share of scanned pages not reclaimed, in %, for each level */
+static unsigned int vmpressure_level_med = 60;
+static unsigned int vmpressure_level_critical = 95;
+
+/* a level older than this means reclaim stopped, the pressure is low */
+#define VMPRESSURE_TIMEOUT	HZ
+
+static DEFINE_SPINLOCK(vmpressure_lock);
+static unsigned long vmpressure_scanned;
+static unsigned long vmpressure_reclaimed;
+static enum vmpressure_levels vmpressure_cur_level;
+static unsigned long vmpressure_stamp;
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
+						    unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	if (reclaimed >= scanned)
+		return VMPRESSURE_LOW;
+
+	pressure = (scanned - reclaimed) * 100 / scanned;
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static void vmpressure_notify_fn(struct work_struct *work)
+{
+	sysfs_notify(mm_kobj, "vmpressure", "level");
+}
+
+static DECLARE_WORK(vmpressure_work, vmpressure_notify_fn);
+
+/**
+ * vmpressure() - account the outcome of a reclaim pass
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from reclaim, which may hold locks, so pollers are only woken
+ * from a work item. They are woken for every new level above low, and
+ * when the level drops back to low.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	enum vmpressure_levels level, old;
+
+	/*
+	 * Only count reclaim userspace can help with by freeing memory,
+	 * not allocations that can't do IO or use highmem and movable
+	 * pages.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpressure_lock);
+	vmpressure_scanned += scanned;
+	vmpressure_reclaimed += reclaimed;
+	if (vmpressure_scanned < vmpressure_win) {
+		spin_unlock(&vmpressure_lock);
+		return;
+	}
+	level = vmpressure_calc_level(vmpressure_scanned,
+				      vmpressure_reclaimed);
+	vmpressure_scanned = 0;
+	vmpressure_reclaimed = 0;
+	old = vmpressure_level();
+	vmpressure_cur_level = level;
+	vmpressure_stamp = jiffies;
+	spin_unlock(&vmpressure_lock);
+
+	if (level != VMPRESSURE_LOW || old != VMPRESSURE_LOW)
+		schedule_work(&vmpressure_work);
+}
+
+/**
+ * vmpressure_level() - the current memory pressure level
+ */
+enum vmpressure_levels vmpressure_level(void)
+{
+	if (time_after(jiffies, vmpressure_stamp + VMPRESSURE_TIMEOUT))
+		return VMPRESSURE_LOW;
+	return vmpressure_cur_level;
+}
+EXPORT_SYMBOL_GPL(vmpressure_level);
+
+#ifdef CONFIG_SYSFS
+
+static ssize_t level_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", vmpressure_str_levels[vmpressure_level()]);
+}
+static struct kobj_attribute level_attr = __ATTR_RO(level);
+
+#define VMPRESSURE_SYSFS_RW(_name) \
+	static ssize_t _name##_show(struct kobject *kobj, \
+				struct kobj_attribute *attr, char *buf) \
+	{ \
+		return sprintf(buf, "%u\n", vmpressure_##_name); \
+	} \
+	static ssize_t _name##_store(struct kobject *kobj, \
+				struct kobj_attribute *attr, \
+				const char *buf, size_t count) \
+	{ \
+		unsigned int val; \
+		if (kstrtouint(buf, 10, &val) || val > 100) \
+			return -EINVAL; \
+		vmpressure_##_name = val; \
+		return count; \
+	} \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+VMPRESSURE_SYSFS_RW(level_med);
+VMPRESSURE_SYSFS_RW(level_critical);
+
+static struct attribute *vmpressure_attrs[] = {
+	&level_attr.attr,
+	&level_med_attr.attr,
+	&level_critical_attr.attr,
+	NULL,
+};
+
+static struct attribute_group vmpressure_attr_group = {
+	.attrs = vmpressure_attrs,
+	.name = "vmpressure",
+};
+
+#endif /* CONFIG_SYSFS */
+
+static int __init vmpressure_init(void)
+{
+#ifdef CONFIG_SYSFS
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &vmpressure_attr_group);
+	if (err)
+		printk(KERN_ERR "vmpressure: register sysfs failed\n");
+#endif /* CONFIG_SYSFS */
+	return 0;
+}
+module_init(vmpressure_init)
@@ -0,0 +1,519 @@
+/*
+ * binder_stress - synchronous binder transaction throughput
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+/*
+ * Runs 1 to N client/server process pairs at once and reports the number
+ * of round trips (BC_TRANSACTION + BC_REPLY) per second for each step, so
+ * the scaling of the driver across cores can be read off directly. Pair k
+ * is pinned to cpu k unless -A is given.
+ *
+ * The program talks to /dev/binder without libbinder. It becomes the
+ * context manager itself to hand out the server nodes, so servicemanager
+ * has to be stopped first ("stop" on Android stops the whole framework).
+ *
+ * usage: binder_stress [-p pairs] [-t seconds] [-s bytes] [-A]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV		"/dev/binder"
+#define BINDER_MAP_SIZE		(128 * 1024)
+#define MAX_PAIRS		32
+#define MAX_PAYLOAD		4096
+
+/* transaction codes understood by the context manager */
+enum {
+	STRESS_REGISTER = 1,	/* a server hands over its node */
+	STRESS_LOOKUP,		/* a client asks for a server's node */
+	STRESS_ECHO,		/* client to server round trip */
+};
+
+struct stress_msg {
+	struct flat_binder_object obj;
+	uint32_t index;
+};
+
+struct stress_result {
+	uint64_t count;
+	double seconds;
+};
+
+struct bctx {
+	int fd;
+	unsigned char wbuf[512];
+	size_t wlen;
+	unsigned char rbuf[512];
+	size_t rpos;
+	size_t rlen;
+};
+
+static void die(const char *what)
+{
+	fprintf(stderr, "binder_stress: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		die("sched_setaffinity");
+}
+
+static void binder_open(struct bctx *c)
+{
+	struct binder_version vers;
+
+	memset(c, 0, sizeof(*c));
+	c->fd = open(BINDER_DEV, O_RDWR);
+	if (c->fd < 0)
+		die("open " BINDER_DEV);
+	if (ioctl(c->fd, BINDER_VERSION, &vers) < 0)
+		die("BINDER_VERSION");
+	if (vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder_stress: protocol %ld, expected %d\n",
+			vers.protocol_version,
+			BINDER_CURRENT_PROTOCOL_VERSION);
+		exit(1);
+	}
+	if (mmap(NULL, BINDER_MAP_SIZE, PROT_READ, MAP_PRIVATE,
+		 c->fd, 0) == MAP_FAILED)
+		die("mmap");
+}
+
+static void put_cmd(struct bctx *c, uint32_t cmd, const void *data,
+		    size_t size)
+{
+	if (c->wlen + sizeof(cmd) + size > sizeof(c->wbuf)) {
+		fprintf(stderr, "binder_stress: write buffer overflow\n");
+		exit(1);
+	}
+	memcpy(c->wbuf + c->wlen, &cmd, sizeof(cmd));
+	c->wlen += sizeof(cmd);
+	if (size)
+		memcpy(c->wbuf + c->wlen, data, size);
+	c->wlen += size;
+}
+
+/* sends the queued commands and, if @read, blocks for returned work */
+static void binder_flush(struct bctx *c, int read)
+{
+	struct binder_write_read bwr;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_buffer = (unsigned long)c->wbuf;
+	bwr.write_size = c->wlen;
+	if (read) {
+		bwr.read_buffer = (unsigned long)c->rbuf;
+		bwr.read_size = sizeof(c->rbuf);
+	}
+
+	while (ioctl(c->fd, BINDER_WRITE_READ, &bwr) < 0) {
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	}
+
+	if (bwr.write_consumed != (long)c->wlen) {
+		fprintf(stderr, "binder_stress: short write %ld/%zu\n",
+			bwr.write_consumed, c->wlen);
+		exit(1);
+	}
+	c->wlen = 0;
+	c->rpos = 0;
+	c->rlen = bwr.read_consumed;
+}
+
+static void free_buffer(struct bctx *c, const void *buffer)
+{
+	put_cmd(c, BC_FREE_BUFFER, &buffer, sizeof(buffer));
+}
+
+static void put_txn(struct bctx *c, uint32_t cmd, uint32_t handle,
+		    uint32_t code, const void *data, size_t size,
+		    const size_t *offsets, size_t offsets_size)
+{
+	struct binder_transaction_data txn;
+
+	memset(&txn, 0, sizeof(txn));
+	txn.target.handle = handle;
+	txn.code = code;
+	txn.data_size = size;
+	txn.offsets_size = offsets_size;
+	txn.data.ptr.buffer = data;
+	txn.data.ptr.offsets = offsets;
+	put_cmd(c, cmd, &txn, sizeof(txn));
+}
+
+/*
+ * Returns the next BR_TRANSACTION, BR_REPLY or failure, flushing queued
+ * commands whenever more work has to be read. Reference count requests
+ * on our nodes are acknowledged here.
+ */
+static uint32_t next_cmd(struct bctx *c, struct binder_transaction_data *txn)
+{
+	for (;;) {
+		struct binder_ptr_cookie pc;
+		uint32_t cmd;
+		size_t size;
+
+		while (c->rpos >= c->rlen)
+			binder_flush(c, 1);
+
+		memcpy(&cmd, c->rbuf + c->rpos, sizeof(cmd));
+		c->rpos += sizeof(cmd);
+		size = _IOC_SIZE(cmd);
+		if (c->rpos + size > c->rlen) {
+			fprintf(stderr, "binder_stress: truncated 0x%x\n", cmd);
+			exit(1);
+		}
+
+		switch (cmd) {
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(txn, c->rbuf + c->rpos, sizeof(*txn));
+			c->rpos += size;
+			return cmd;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+			memcpy(&pc, c->rbuf + c->rpos, sizeof(pc));
+			put_cmd(c, cmd == BR_INCREFS ? BC_INCREFS_DONE :
+				BC_ACQUIRE_DONE, &pc, sizeof(pc));
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+		case BR_ERROR:
+			return cmd;
+		default:
+			/* BR_NOOP, BR_TRANSACTION_COMPLETE, BR_RELEASE, ... */
+			break;
+		}
+		c->rpos += size;
+	}
+}
+
+static void wait_reply(struct bctx *c, struct binder_transaction_data *txn)
+{
+	uint32_t cmd;
+
+	do {
+		cmd = next_cmd(c, txn);
+	} while (cmd == BR_TRANSACTION);
+
+	if (cmd != BR_REPLY) {
+		fprintf(stderr, "binder_stress: transaction failed (0x%x)\n",
+			cmd);
+		exit(1);
+	}
+}
+
+static void notify(int fd)
+{
+	char c = 0;
+
+	if (write(fd, &c, 1) != 1)
+		die("notify");
+}
+
+static void wait_for(int fd, int n)
+{
+	char c;
+
+	while (n--) {
+		if (read(fd, &c, 1) != 1)
+			die("wait");
+	}
+}
+
+static void run_manager(int ready_fd, int pairs)
+{
+	static struct stress_msg reply;
+	static const size_t offsets[] = { 0 };
+	uint32_t servers[MAX_PAIRS];
+	int known[MAX_PAIRS] = { 0 };
+	struct bctx c;
+
+	binder_open(&c);
+	if (ioctl(c.fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		die("BINDER_SET_CONTEXT_MGR (is servicemanager running?)");
+	put_cmd(&c, BC_ENTER_LOOPER, NULL, 0);
+	notify(ready_fd);
+
+	for (;;) {
+		struct binder_transaction_data txn;
+		const struct stress_msg *msg;
+		size_t offsets_size = 0;
+
+		if (next_cmd(&c, &txn) != BR_TRANSACTION)
+			continue;
+
+		msg = txn.data.ptr.buffer;
+		memset(&reply, 0, sizeof(reply));
+		reply.index = (uint32_t)-1;
+
+		if (txn.data_size >= sizeof(*msg) &&
+		    msg->index < (uint32_t)pairs) {
+			uint32_t i = msg->index;
+
+			if (txn.code == STRESS_REGISTER &&
+			    msg->obj.type == BINDER_TYPE_HANDLE) {
+				uint32_t handle = msg->obj.handle;
+
+				/* keep it past the free of this buffer */
+				put_cmd(&c, BC_ACQUIRE, &handle,
+					sizeof(handle));
+				servers[i] = handle;
+				known[i] = 1;
+			} else if (txn.code == STRESS_LOOKUP && known[i]) {
+				reply.obj.type = BINDER_TYPE_HANDLE;
+				reply.obj.handle = servers[i];
+				reply.index = i;
+				offsets_size = sizeof(offsets);
+			}
+		}
+
+		free_buffer(&c, txn.data.ptr.buffer);
+		put_txn(&c, BC_REPLY, 0, 0, &reply, sizeof(reply),
+			offsets, offsets_size);
+		/* 'reply' is reused, so don't leave it queued */
+		binder_flush(&c, 0);
+	}
+}
+
+static void run_server(int index, int cpu, int ready_fd, size_t size)
+{
+	static unsigned char payload[MAX_PAYLOAD];
+	static struct stress_msg msg;
+	static const size_t offsets[] = { 0 };
+	struct binder_transaction_data txn;
+	struct bctx c;
+
+	if (cpu >= 0)
+		pin_to_cpu(cpu);
+	binder_open(&c);
+
+	msg.obj.type = BINDER_TYPE_BINDER;
+	msg.obj.binder = (void *)(uintptr_t)(index + 1);
+	msg.obj.cookie = msg.obj.binder;
+	msg.index = index;
+	put_txn(&c, BC_TRANSACTION, 0, STRESS_REGISTER, &msg, sizeof(msg),
+		offsets, sizeof(offsets));
+	wait_reply(&c, &txn);
+	free_buffer(&c, txn.data.ptr.buffer);
+	put_cmd(&c, BC_ENTER_LOOPER, NULL, 0);
+	notify(ready_fd);
+
+	for (;;) {
+		if (next_cmd(&c, &txn) != BR_TRANSACTION)
+			continue;
+		free_buffer(&c, txn.data.ptr.buffer);
+		put_txn(&c, BC_REPLY, 0, 0, payload, size, NULL, 0);
+	}
+}
+
+static void run_client(int index, int cpu, int ready_fd, int start_fd,
+		       int result_fd, double seconds, size_t size)
+{
+	static unsigned char payload[MAX_PAYLOAD];
+	static struct stress_msg msg;
+	struct binder_transaction_data txn;
+	const struct stress_msg *reply;
+	struct stress_result res;
+	uint32_t handle;
+	double start, end;
+	struct bctx c;
+
+	if (cpu >= 0)
+		pin_to_cpu(cpu);
+	binder_open(&c);
+
+	msg.index = index;
+	put_txn(&c, BC_TRANSACTION, 0, STRESS_LOOKUP, &msg, sizeof(msg),
+		NULL, 0);
+	wait_reply(&c, &txn);
+	reply = txn.data.ptr.buffer;
+	if (txn.data_size < sizeof(*reply) ||
+	    reply->obj.type != BINDER_TYPE_HANDLE) {
+		fprintf(stderr, "binder_stress: no server %d\n", index);
+		exit(1);
+	}
+	handle = reply->obj.handle;
+	put_cmd(&c, BC_ACQUIRE, &handle, sizeof(handle));
+	free_buffer(&c, txn.data.ptr.buffer);
+	binder_flush(&c, 0);
+
+	notify(ready_fd);
+	wait_for(start_fd, 1);
+
+	res.count = 0;
+	start = now();
+	end = start + seconds;
+	do {
+		int i;
+
+		for (i = 0; i < 64; i++) {
+			put_txn(&c, BC_TRANSACTION, handle, STRESS_ECHO,
+				payload, size, NULL, 0);
+			wait_reply(&c, &txn);
+			/* goes out with the next transaction */
+			free_buffer(&c, txn.data.ptr.buffer);
+		}
+		res.count += 64;
+	} while (now() < end);
+	res.seconds = now() - start;
+	binder_flush(&c, 0);
+
+	if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+		die("write result");
+	exit(0);
+}
+
+static pid_t spawn(void)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		die("fork");
+	return pid;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: binder_stress [-p pairs] [-t seconds] "
+		"[-s bytes] [-A]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	int pairs = ncpus;
+	double seconds = 5;
+	size_t size = 16;
+	int affinity = 1;
+	pid_t helpers[MAX_PAIRS + 1];
+	int ready[2], start[2], result[2];
+	double base = 0;
+	int nhelpers = 0;
+	int opt, i, p;
+
+	while ((opt = getopt(argc, argv, "p:t:s:A")) != -1) {
+		switch (opt) {
+		case 'p':
+			pairs = atoi(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'A':
+			affinity = 0;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (pairs < 1 || pairs > MAX_PAIRS || seconds <= 0 ||
+	    size < sizeof(uint32_t) || size > MAX_PAYLOAD)
+		usage();
+
+	if (pipe(ready) || pipe(result))
+		die("pipe");
+
+	helpers[nhelpers] = spawn();
+	if (!helpers[nhelpers])
+		run_manager(ready[1], pairs);
+	nhelpers++;
+	wait_for(ready[0], 1);
+
+	for (i = 0; i < pairs; i++) {
+		helpers[nhelpers] = spawn();
+		if (!helpers[nhelpers])
+			run_server(i, affinity ? i % ncpus : -1, ready[1],
+				   size);
+		nhelpers++;
+	}
+	wait_for(ready[0], pairs);
+
+	printf("%-6s %-12s %-12s %s\n", "pairs", "tx/s", "tx/s/pair",
+	       "scaling");
+	for (p = 1; p <= pairs; p++) {
+		double total = 0;
+
+		if (pipe(start))
+			die("pipe");
+		for (i = 0; i < p; i++) {
+			if (!spawn())
+				run_client(i, affinity ? i % ncpus : -1,
+					   ready[1], start[0], result[1],
+					   seconds, size);
+		}
+		wait_for(ready[0], p);
+		for (i = 0; i < p; i++)
+			notify(start[1]);
+
+		for (i = 0; i < p; i++) {
+			struct stress_result res;
+
+			if (read(result[0], &res, sizeof(res)) != sizeof(res))
+				die("read result");
+			total += res.count / res.seconds;
+		}
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			;
+		close(start[0]);
+		close(start[1]);
+
+		if (p == 1)
+			base = total;
+		printf("%-6d %-12.0f %-12.0f %.2fx\n", p, total, total / p,
+		       total / base);
+		fflush(stdout);
+	}
+
+	for (i = 0; i < nhelpers; i++)
+		kill(helpers[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * logger_bench - log device write throughput
+ *
+ * Copyright (c) 2013, TripNDroid Mobile Engineering
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+/*
+ * Runs 1 to N writer threads at once and reports the entries written per
+ * second for each step. Every thread opens the log itself and writes
+ * entries laid out like liblog's (priority, tag, message) with writev(),
+ * so the numbers match what Android's writers see. Thread k is pinned to
+ * cpu k unless -A is given.
+ *
+ * usage: logger_bench [-l log] [-j threads] [-t seconds] [-s bytes] [-A]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define MAX_THREADS	32
+#define MAX_MSG		4000
+#define LOG_PRIO_INFO	4
+
+static const char *log_path = "/dev/log/main";
+static double seconds = 5;
+static size_t msg_size = 100;
+static int affinity = 1;
+static int ncpus;
+static pthread_barrier_t barrier;
+
+struct writer {
+	pthread_t thread;
+	int index;
+	uint64_t count;
+	double seconds;
+};
+
+static void die(const char *what)
+{
+	fprintf(stderr, "logger_bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *writer_fn(void *arg)
+{
+	static const char tag[] = "logger_bench";
+	struct writer *w = arg;
+	unsigned char prio = LOG_PRIO_INFO;
+	char msg[MAX_MSG + 1];
+	struct iovec vec[3];
+	double start, end;
+	int fd;
+
+	if (affinity) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(w->index % ncpus, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			die("pthread_setaffinity_np");
+	}
+
+	fd = open(log_path, O_WRONLY);
+	if (fd < 0)
+		die(log_path);
+
+	memset(msg, 'x', msg_size);
+	msg[msg_size] = '\0';
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = (void *)tag;
+	vec[1].iov_len = sizeof(tag);
+	vec[2].iov_base = msg;
+	vec[2].iov_len = msg_size + 1;
+
+	pthread_barrier_wait(&barrier);
+
+	w->count = 0;
+	start = now();
+	end = start + seconds;
+	do {
+		int i;
+
+		for (i = 0; i < 64; i++) {
+			if (writev(fd, vec, 3) < 0)
+				die("writev");
+		}
+		w->count += 64;
+	} while (now() < end);
+	w->seconds = now() - start;
+
+	close(fd);
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: logger_bench [-l log] [-j threads] "
+		"[-t seconds] [-s bytes] [-A]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct writer writers[MAX_THREADS];
+	int threads;
+	double base = 0;
+	int opt, i, n;
+
+	ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	threads = ncpus;
+
+	while ((opt = getopt(argc, argv, "l:j:t:s:A")) != -1) {
+		switch (opt) {
+		case 'l':
+			log_path = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 's':
+			msg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'A':
+			affinity = 0;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (threads < 1 || threads > MAX_THREADS || seconds <= 0 ||
+	    msg_size > MAX_MSG)
+		usage();
+
+	printf("%-8s %-12s %-12s %s\n", "threads", "writes/s", "writes/s/thr",
+	       "scaling");
+	for (n = 1; n <= threads; n++) {
+		double total = 0;
+
+		if (pthread_barrier_init(&barrier, NULL, n))
+			die("pthread_barrier_init");
+		for (i = 0; i < n; i++) {
+			writers[i].index = i;
+			errno = pthread_create(&writers[i].thread, NULL,
+					       writer_fn, &writers[i]);
+			if (errno)
+				die("pthread_create");
+		}
+		for (i = 0; i < n; i++) {
+			pthread_join(writers[i].thread, NULL);
+			total += writers[i].count / writers[i].seconds;
+		}
+		pthread_barrier_destroy(&barrier);
+
+		if (n == 1)
+			base = total;
+		printf("%-8d %-12.0f %-12.0f %.2fx\n", n, total, total / n,
+		       total / base);
+		fflush(stdout);
+	}
+
+	return 0;
+}